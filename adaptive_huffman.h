@@ -0,0 +1,268 @@
+// adaptive_huffman.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - TAdaptiveHuffman
+	One pass huffman coding (the FGK algorithm). Instead of counting the
+	whole input first, both sides start with an empty tree and update it
+	after every letter, the decoder making exactly the same updates as the
+	encoder. There is no header and output is ready as soon as the letters
+	it encodes have been seen, so it suits pipes and sockets where the
+	input can't be held or read twice. It packs a little worse than
+	THuffman and is a lot slower, as the tree changes with every letter.
+
+	-- stream format --
+	each letter is either its current code, or if it has not been seen
+	before the code of the "not yet transmitted" leaf followed by the letter
+	in 9 bits. the value 256 in those 9 bits ends the stream, the rest of
+	the last byte is 0s.
+
+	Usage Example:
+
+	TAdaptiveHuffman encoder, decoder;
+	std::string packed, plain;
+	encoder.Encode((const unsigned char *)"peter piper", 11, packed);
+	encoder.Finish(packed);
+	decoder.Decode((const unsigned char *)packed.data(), packed.size(), plain);
+	// decoder.Finished() is now true and plain is "peter piper"
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include "bit_buffer.h"
+
+
+class TAdaptiveHuffman {
+
+	private:
+
+		// 256 letters and the not yet transmitted leaf
+		enum { MAX_NODES = 2 * 257 - 1, NONE = 0xFFFF };
+		enum { LETTER_BITS = 9, END_OF_STREAM = 256, NYT = 0x100 };
+
+		/*
+		-- implimentation note --
+		nodes are numbered so that weights never go down as the number
+		goes up, and siblings are next to each other (the sibling property).
+		the root is the last node, new nodes are taken from below the
+		not yet transmitted leaf, which is always the lowest numbered node
+		*/
+		struct node_t {
+			uint64_t weight;
+			unsigned short parent;
+			unsigned short left, right;	// NONE for a leaf
+			unsigned short letter;		// NYT for the not yet transmitted leaf
+		};
+
+		node_t				nodes[MAX_NODES];
+		unsigned short		leaves[256];		// NONE until the letter is seen
+		unsigned short		nyt;
+
+		// -- encoding:
+		TBitBuffer			bits;
+		// -- decoding:
+		unsigned short		node;			// where the walk down the tree has got to
+		unsigned int		letterBits;		// >0 while reading a new letter
+		unsigned int		letter;
+		bool				finished;
+
+		void				_Update(unsigned int);
+		void				_Swap(unsigned short, unsigned short);
+		void				_AppendCode(unsigned short);
+		bool				_Decoded(unsigned int, std::string &);
+
+	public:
+
+		TAdaptiveHuffman() { Reset(); }
+
+		// start again with an empty tree, for a new stream
+		void				Reset();
+
+		// appends every whole byte of output that is ready to 'out'
+		void				Encode(const unsigned char *, size_t, std::string &);
+		// ends the stream, appending the rest of the output
+		void				Finish(std::string &);
+
+		// appends the letters decoded from the next part of the stream to
+		// 'out'. returns false if the stream is not valid
+		bool				Decode(const unsigned char *, size_t, std::string &);
+		// true once the end of the stream has been decoded, anything
+		// after it is ignored
+		bool				Finished() const { return finished; }
+
+};
+
+
+inline void TAdaptiveHuffman::Reset()
+{
+	nyt = MAX_NODES - 1;
+	node_t & root = nodes[nyt];
+	root.weight = 0;
+	root.parent = NONE;
+	root.left = root.right = NONE;
+	root.letter = NYT;
+	for(int i=0;i<256;i++)
+		leaves[i] = NONE;
+
+	bits.Clear();
+	node = MAX_NODES - 1;
+	// the root is the not yet transmitted leaf, so a letter comes first
+	letterBits = LETTER_BITS;
+	letter = 0;
+	finished = false;
+}
+
+
+// the bits from the root down to 'n'
+inline void TAdaptiveHuffman::_AppendCode(unsigned short n)
+{
+	// the walk goes up from the leaf, so the bits come out backwards
+	unsigned char path[MAX_NODES];
+	unsigned int len = 0;
+	for(;nodes[n].parent != NONE;n=nodes[n].parent)
+		path[len++] = (nodes[nodes[n].parent].right == n);
+	while(len > 0) {
+		unsigned int chunk = (len < 56) ? len : 56;
+		uint64_t code = 0;
+		for(unsigned int i=0;i<chunk;i++)
+			code = (code << 1) | path[--len];
+		bits.AppendBits(code, chunk);
+	}
+}
+inline void TAdaptiveHuffman::Encode(const unsigned char *data, size_t len, std::string & out)
+{
+	for(size_t i=0;i<len;i++) {
+		unsigned short leaf = leaves[data[i]];
+		if(leaf != NONE) {
+			_AppendCode(leaf);
+		} else {
+			_AppendCode(nyt);
+			bits.AppendBits(data[i], LETTER_BITS);
+		}
+		_Update(data[i]);
+	}
+	bits.TakeBytes(out);
+}
+inline void TAdaptiveHuffman::Finish(std::string & out)
+{
+	_AppendCode(nyt);
+	bits.AppendBits(END_OF_STREAM, LETTER_BITS);
+	bits.Flush();
+	bits.TakeBytes(out);
+}
+
+
+// one bit at a time, as the stream may stop in the middle of a code
+inline bool TAdaptiveHuffman::Decode(const unsigned char *data, size_t len, std::string & out)
+{
+	for(size_t i=0;i<len && !finished;i++) {
+		for(int b=7;b>=0 && !finished;b--) {
+			unsigned int bit = (data[i] >> b) & 1;
+
+			// a new letter, in full
+			if(letterBits > 0) {
+				letter = (letter << 1) | bit;
+				if(--letterBits > 0) continue;
+				if(letter == END_OF_STREAM) {
+					finished = true;
+					break;
+				}
+				if(letter > END_OF_STREAM || leaves[letter] != NONE) return false;
+				if(!_Decoded(letter, out)) return false;
+				continue;
+			}
+
+			node = bit ? nodes[node].right : nodes[node].left;
+			if(nodes[node].left != NONE) continue;
+			if(nodes[node].letter != NYT) {
+				if(!_Decoded(nodes[node].letter, out)) return false;
+				continue;
+			}
+			letterBits = LETTER_BITS;
+			letter = 0;
+		}
+	}
+	return true;
+}
+// a whole letter has been read, start the walk again from the root
+inline bool TAdaptiveHuffman::_Decoded(unsigned int l, std::string & out)
+{
+	out.append(1, (char)l);
+	_Update(l);
+	node = MAX_NODES - 1;
+	// until a second letter is seen the root is the only leaf, reached
+	// without reading anything
+	if(nodes[node].left == NONE) {
+		letterBits = LETTER_BITS;
+		letter = 0;
+	}
+	return true;
+}
+
+
+// swap the subtrees at 'a' and 'b', each taking the other's place
+inline void TAdaptiveHuffman::_Swap(unsigned short a, unsigned short b)
+{
+	unsigned short parentA = nodes[a].parent, parentB = nodes[b].parent;
+	node_t tmp = nodes[a];
+	nodes[a] = nodes[b];
+	nodes[b] = tmp;
+	nodes[a].parent = parentA;
+	nodes[b].parent = parentB;
+
+	unsigned short moved[2] = { a, b };
+	for(int i=0;i<2;i++) {
+		node_t & n = nodes[moved[i]];
+		if(n.left != NONE) {
+			nodes[n.left].parent = moved[i];
+			nodes[n.right].parent = moved[i];
+		} else if(n.letter == NYT) {
+			nyt = moved[i];
+		} else {
+			leaves[n.letter] = moved[i];
+		}
+	}
+}
+// count one more of 'l', keeping the sibling property
+inline void TAdaptiveHuffman::_Update(unsigned int l)
+{
+	unsigned short q = leaves[l];
+	if(q == NONE) {
+		// the not yet transmitted leaf becomes the parent of the new
+		// letter and a new not yet transmitted leaf
+		unsigned short parent = nyt;
+		unsigned short leaf = parent - 1;
+		nyt = parent - 2;
+		nodes[parent].left = nyt;
+		nodes[parent].right = leaf;
+		nodes[parent].letter = 0;
+
+		nodes[leaf].weight = 0;
+		nodes[leaf].parent = parent;
+		nodes[leaf].left = nodes[leaf].right = NONE;
+		nodes[leaf].letter = (unsigned short)l;
+		leaves[l] = leaf;
+
+		nodes[nyt].weight = 0;
+		nodes[nyt].parent = parent;
+		nodes[nyt].left = nodes[nyt].right = NONE;
+		nodes[nyt].letter = NYT;
+		q = leaf;
+	}
+
+	while(q != NONE) {
+		// move to the highest numbered node of the same weight, unless
+		// that is our parent, so adding one keeps the order
+		unsigned short leader = q;
+		while(leader + 1 < MAX_NODES && nodes[leader + 1].weight == nodes[q].weight)
+			leader++;
+		if(leader != q && leader != nodes[q].parent) {
+			_Swap(q, leader);
+			q = leader;
+		}
+		nodes[q].weight++;
+		q = nodes[q].parent;
+	}
+}
@@ -0,0 +1,426 @@
+// huffman_bench.cpp
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - Benchmark
+	Times each stage of THuffman on its own over a set of generated corpora.
+	The corpora come from a fixed seed, so every run on every machine works
+	on exactly the same bytes and the numbers can be compared.
+
+	Results go to stdout as JSON, progress goes to stderr. Each stage is
+	timed over several whole encode/decode passes and the fastest pass is
+	reported, as MB/s (10^6 bytes per second) and ns per input byte.
+
+	Usage Example:
+
+	huffman_bench > before.json
+	huffman_bench -c english,tiny -s 1048576 -m 2 > after.json
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "huffman.h"
+
+
+// xorshift64*, so the corpora do not depend on the C library's rand()
+class TBenchRandom {
+
+	private:
+
+		uint64_t			state;
+
+	public:
+
+		TBenchRandom(uint64_t seed) { state = seed ? seed : 1; }
+
+		uint64_t			Next()
+		{
+			state ^= state >> 12;
+			state ^= state << 25;
+			state ^= state >> 27;
+			return state * 0x2545F4914F6CDD1DULL;
+		}
+		// 0 to n-1
+		uint32_t			Below(uint32_t n) { return (uint32_t)((Next() >> 32) * n >> 32); }
+
+};
+
+
+/*
+	-- corpora --
+	english:	words picked by a zipf distribution from a list of common
+				words, with some punctuation and line breaks
+	skewed:		binary, each block of 16 byte values half as likely as the
+				block before, so all 256 values turn up but few are common
+	random:		uniform bytes, nothing to gain
+	single:		one letter repeated
+	tiny:		english text, encoded as separate 64 byte messages
+*/
+struct corpus_t {
+	const char *name;
+	size_t messageSize;		// 0 for the whole corpus as one message
+};
+static const corpus_t CORPORA[] = {
+	{ "english", 0 },
+	{ "skewed", 0 },
+	{ "random", 0 },
+	{ "single", 0 },
+	{ "tiny", 64 }
+};
+static const size_t CORPUS_COUNT = sizeof(CORPORA) / sizeof(CORPORA[0]);
+
+
+static void MakeEnglish(std::string & out, size_t size, TBenchRandom & rnd)
+{
+	static const char *words[] = {
+		"the", "of", "and", "to", "a", "in", "is", "it", "you", "that",
+		"he", "was", "for", "on", "are", "with", "as", "his", "they", "be",
+		"at", "one", "have", "this", "from", "or", "had", "by", "not", "word",
+		"but", "what", "some", "we", "can", "out", "other", "were", "all", "there",
+		"when", "up", "use", "your", "how", "said", "an", "each", "she", "which",
+		"do", "their", "time", "if", "will", "way", "about", "many", "then", "them",
+		"write", "would", "like", "so", "these", "her", "long", "make", "thing", "see",
+		"him", "two", "has", "look", "more", "day", "could", "go", "come", "did",
+		"number", "sound", "no", "most", "people", "my", "over", "know", "water", "than",
+		"call", "first", "who", "may", "down", "side", "been", "now", "find", "huffman"
+	};
+	const uint32_t count = sizeof(words) / sizeof(words[0]);
+
+	// zipf: the word at rank r is picked in proportion to 1/(r+1)
+	std::vector<uint32_t> cumulative(count);
+	double total = 0;
+	for(uint32_t i=0;i<count;i++) {
+		total += 1.0 / (i + 1);
+		cumulative[i] = (uint32_t)(total * 1000000);
+	}
+
+	bool capital = true;
+	out.clear();
+	out.reserve(size + 16);
+	while(out.size() < size) {
+		uint32_t pick = rnd.Below(cumulative[count-1]);
+		uint32_t w = 0;
+		while(cumulative[w] <= pick) w++;
+		size_t start = out.size();
+		out.append(words[w]);
+		if(capital) out[start] = (char)(out[start] - 'a' + 'A');
+		capital = false;
+
+		uint32_t p = rnd.Below(100);
+		if(p < 6) {
+			out.append(". ");
+			capital = true;
+		} else if(p < 10) {
+			out.append(", ");
+		} else if(p < 11) {
+			out.append(".\n");
+			capital = true;
+		} else {
+			out.append(" ");
+		}
+	}
+	out.resize(size);
+}
+static void MakeSkewed(std::string & out, size_t size, TBenchRandom & rnd)
+{
+	out.resize(size);
+	for(size_t i=0;i<size;i++) {
+		uint64_t v = rnd.Next();
+		// how many times a coin came up heads picks the block
+		unsigned int block = 0;
+		while(block < 15 && (v & ((uint64_t)1 << (63 - block))) != 0) block++;
+		out[i] = (char)(block * 16 + (v & 15));
+	}
+}
+static void MakeRandom(std::string & out, size_t size, TBenchRandom & rnd)
+{
+	out.resize(size);
+	for(size_t i=0;i<size;i++)
+		out[i] = (char)(rnd.Next() >> 56);
+}
+static void MakeCorpus(const std::string & name, std::string & out, size_t size)
+{
+	// the seed is fixed, the same corpus comes out every time
+	TBenchRandom rnd(0x5448554646ULL);
+	if(name == "english" || name == "tiny")
+		MakeEnglish(out, size, rnd);
+	else if(name == "skewed")
+		MakeSkewed(out, size, rnd);
+	else if(name == "random")
+		MakeRandom(out, size, rnd);
+	else
+		out.assign(size, 'e');
+}
+
+
+class THuffmanBench {
+
+	public:
+
+		enum stage_t { HISTOGRAM, TREE, TABLE, HEADER, BODY, DECODE, STAGES };
+
+		struct result_t {
+			unsigned int iterations;
+			uint64_t encodedSize;
+			double best[STAGES];		// seconds, the fastest pass of each stage
+		};
+
+	private:
+
+		THuffman huff;
+
+		static double		_Now();
+		void				_Encode(const unsigned char *, size_t, double *, std::string &);
+		bool				_Decode(const std::string &, char *, size_t, double *);
+
+	public:
+
+		static const char	*StageName(int);
+		void				SetMaxCodeLength(unsigned int a) { huff.SetMaxCodeLength(a); }
+		void				SetInterleave(bool a) { huff.SetInterleave(a); }
+		void				SetContexts(bool a) { huff.SetContexts(a); }
+
+		// encode and decode 'data' as messages of 'messageSize' bytes until
+		// at least 'minTime' seconds have passed. false if any message
+		// did not decode back to what went in
+		bool				Run(const std::string &, size_t, double, result_t &);
+
+};
+
+
+inline double THuffmanBench::_Now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline const char *THuffmanBench::StageName(int stage)
+{
+	static const char *names[STAGES] = { "histogram", "tree_build", "table_build", "header", "body_encode", "decode" };
+	return names[stage];
+}
+
+
+// the same steps as THuffman::_Encode(), with a clock around each one
+inline void THuffmanBench::_Encode(const unsigned char *data, size_t len, double *times, std::string & out)
+{
+	huff.plainData = data;
+	huff.plainSize = len;
+	huff.encodedText.Clear();
+
+	double t0 = _Now();
+	huff._CountLetters();
+	double t1 = _Now();
+	huff._PopulateForest();
+	huff._BuildBitTree();
+	double t2 = _Now();
+	huff._BuildTables();
+	double t3 = _Now();
+	TBitBuffer body;
+	uint64_t bodySize = huff._EncodeBody(body);
+	double t4 = _Now();
+	huff._WriteHeader(bodySize);
+	double t5 = _Now();
+	huff._AppendBody(body);
+	huff.encodedText.Flush();
+	double t6 = _Now();
+
+	times[HISTOGRAM] += t1 - t0;
+	times[TREE] += t2 - t1;
+	times[TABLE] += t3 - t2;
+	times[BODY] += (t4 - t3) + (t6 - t5);
+	times[HEADER] += t5 - t4;
+
+	huff.__CleanUp();
+	huff.plainData = NULL;
+	out.append(huff.encodedText.Bytes());
+}
+inline bool THuffmanBench::_Decode(const std::string & message, char *out, size_t len, double *times)
+{
+	double t0 = _Now();
+	huff.encodedText.AttachBytes((const unsigned char *)message.data(), message.size());
+	bool r = huff._Decode(out, len);
+	times[DECODE] += _Now() - t0;
+	return r;
+}
+
+
+inline bool THuffmanBench::Run(const std::string & data, size_t messageSize, double minTime, result_t & r)
+{
+	if(messageSize == 0) messageSize = data.size();
+	size_t messages = (data.size() + messageSize - 1) / messageSize;
+
+	std::vector<std::string> encoded(messages);
+	std::string decoded(data.size(), 0);
+
+	r.iterations = 0;
+	r.encodedSize = 0;
+	for(int s=0;s<STAGES;s++)
+		r.best[s] = 1e30;
+
+	double start = _Now();
+	// at least 3 passes, so one slow pass can't decide the result
+	while(r.iterations < 3 || _Now() - start < minTime) {
+		double times[STAGES] = { 0 };
+		for(size_t m=0;m<messages;m++) {
+			size_t offset = m * messageSize;
+			size_t len = std::min(messageSize, data.size() - offset);
+			encoded[m].clear();
+			_Encode((const unsigned char *)data.data() + offset, len, times, encoded[m]);
+		}
+		for(size_t m=0;m<messages;m++) {
+			size_t offset = m * messageSize;
+			size_t len = std::min(messageSize, data.size() - offset);
+			if(!_Decode(encoded[m], &decoded[offset], len, times)) return false;
+		}
+		if(decoded != data) return false;
+
+		for(int s=0;s<STAGES;s++)
+			r.best[s] = std::min(r.best[s], times[s]);
+		r.iterations++;
+	}
+
+	for(size_t m=0;m<messages;m++)
+		r.encodedSize += encoded[m].size();
+	return true;
+}
+
+
+static void Usage(char *argv[])
+{
+	fprintf(stderr, "Usage: %s [options] > results.json\n", argv[0]);
+	fputs("Options:\n", stderr);
+	fputs("  -c LIST   corpora to run, from english,skewed,random,single,tiny (default all)\n", stderr);
+	fputs("  -s LIST   corpus sizes in bytes (default 65536,1048576,16777216)\n", stderr);
+	fputs("  -m SECS   keep repeating each run for at least this long (default 0.5)\n", stderr);
+	fputs("  -l N      maximum code length (default 15)\n", stderr);
+	fputs("  -4        split message bodies into 4 interleaved substreams\n", stderr);
+	fputs("  -x        order-1 context tables, where they come out smaller\n", stderr);
+}
+
+// splits "a,b,c"
+static std::vector<std::string> SplitList(const char *list)
+{
+	std::vector<std::string> r;
+	std::string item;
+	for(const char *p=list;;p++) {
+		if(*p == ',' || *p == 0) {
+			if(!item.empty()) r.push_back(item);
+			item.clear();
+			if(*p == 0) break;
+		} else {
+			item.append(1, *p);
+		}
+	}
+	return r;
+}
+
+
+int main(int argc, char *argv[])
+{
+	std::vector<std::string> corpora;
+	for(size_t i=0;i<CORPUS_COUNT;i++)
+		corpora.push_back(CORPORA[i].name);
+	std::vector<size_t> sizes;
+	sizes.push_back(64 << 10);
+	sizes.push_back(1 << 20);
+	sizes.push_back(16 << 20);
+	double minTime = 0.5;
+	unsigned int maxCodeLength = 15;
+
+	bool interleave = false, contexts = false;
+
+	for(int arg=1;arg<argc;arg+=2) {
+		if(strcmp(argv[arg], "-4") == 0 || strcmp(argv[arg], "-x") == 0) {
+			if(argv[arg][1] == '4') interleave = true;
+			else contexts = true;
+			arg--;
+			continue;
+		}
+		if(arg + 1 >= argc) {
+			Usage(argv);
+			return 1;
+		}
+		if(strcmp(argv[arg], "-c") == 0) {
+			corpora = SplitList(argv[arg+1]);
+		} else if(strcmp(argv[arg], "-s") == 0) {
+			std::vector<std::string> list = SplitList(argv[arg+1]);
+			sizes.clear();
+			for(size_t i=0;i<list.size();i++)
+				sizes.push_back(strtoull(list[i].c_str(), NULL, 10));
+		} else if(strcmp(argv[arg], "-m") == 0) {
+			minTime = atof(argv[arg+1]);
+		} else if(strcmp(argv[arg], "-l") == 0) {
+			maxCodeLength = atoi(argv[arg+1]);
+		} else {
+			Usage(argv);
+			return 1;
+		}
+	}
+	for(size_t c=0;c<corpora.size();c++) {
+		size_t i = 0;
+		while(i < CORPUS_COUNT && corpora[c] != CORPORA[i].name) i++;
+		if(i == CORPUS_COUNT) {
+			fprintf(stderr, "Unknown corpus: %s\n", corpora[c].c_str());
+			return 1;
+		}
+	}
+
+	printf("{\n");
+	printf("  \"benchmark\": \"huffman_bench\",\n");
+#if defined(__VERSION__)
+	printf("  \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+	printf("  \"min_time\": %g,\n", minTime);
+	printf("  \"max_code_length\": %u,\n", maxCodeLength);
+	printf("  \"interleave\": %s,\n", interleave ? "true" : "false");
+	printf("  \"contexts\": %s,\n", contexts ? "true" : "false");
+	printf("  \"results\": [");
+
+	bool first = true;
+	std::string data;
+	for(size_t c=0;c<corpora.size();c++) {
+		size_t messageSize = 0;
+		for(size_t i=0;i<CORPUS_COUNT;i++)
+			if(corpora[c] == CORPORA[i].name) messageSize = CORPORA[i].messageSize;
+
+		for(size_t z=0;z<sizes.size();z++) {
+			if(sizes[z] == 0) continue;
+			MakeCorpus(corpora[c], data, sizes[z]);
+
+			THuffmanBench bench;
+			bench.SetMaxCodeLength(maxCodeLength);
+			bench.SetInterleave(interleave);
+			bench.SetContexts(contexts);
+			THuffmanBench::result_t r;
+			if(!bench.Run(data, messageSize, minTime, r)) {
+				fprintf(stderr, "%s/%u: decoded output does not match the input\n", corpora[c].c_str(), (unsigned int)sizes[z]);
+				return 1;
+			}
+
+			fprintf(stderr, "%-8s %9u bytes  ratio %.3f ", corpora[c].c_str(), (unsigned int)data.size(), (double)r.encodedSize / data.size());
+			printf("%s\n    {\n", first ? "" : ",");
+			printf("      \"corpus\": \"%s\",\n", corpora[c].c_str());
+			printf("      \"size\": %u,\n", (unsigned int)data.size());
+			printf("      \"message_size\": %u,\n", (unsigned int)(messageSize ? messageSize : data.size()));
+			printf("      \"encoded_size\": %llu,\n", (unsigned long long)r.encodedSize);
+			printf("      \"iterations\": %u,\n", r.iterations);
+			printf("      \"stages\": {");
+			for(int s=0;s<THuffmanBench::STAGES;s++) {
+				double seconds = std::max(r.best[s], 1e-12);
+				double mbps = data.size() / seconds / 1e6;
+				double nspb = seconds * 1e9 / data.size();
+				printf("%s\n        \"%s\": { \"mb_per_s\": %.2f, \"ns_per_byte\": %.4f }", s ? "," : "", THuffmanBench::StageName(s), mbps, nspb);
+				fprintf(stderr, " %s %.1f", THuffmanBench::StageName(s), mbps);
+			}
+			printf("\n      }\n    }");
+			fprintf(stderr, " MB/s\n");
+			first = false;
+		}
+	}
+
+	printf("\n  ]\n}\n");
+	return 0;
+}
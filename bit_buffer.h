@@ -4,116 +4,361 @@
 	All rights reserved. See LICENCE for details.
 	--
 	Toby's Huffman Compression - TBitBuffer
-	A wrapper for a string object to handle a stream of bits.
-	
+	A packed stream of bits. Bits are written most significant first into a
+	64-bit accumulator which is flushed to the byte buffer a whole word at a
+	time. Reads refill a whole 64-bit word from the bytes at the current
+	position, so peeking at the next few bits costs one load and a shift.
+
 	Usage Example:
 
 	TBitBuffer foo;
-	foo.Assign("0000");
-	foo.AppendByte(200);		// will be converted to "11001000"
-	foo.AppendByte('a');		// will be converted to "10011111"
-	foo.AppendBits("00");
-	
-	puts(foo.ReadAllBits());	// prints 00001100100010011111100
-	
-	// note, since we are two bits short of three bytes, ReadAllBytes() 
+	foo.AppendBits(0, 4);		// 0000
+	foo.AppendByte(200);		// 11001000
+	foo.AppendByte('a');		// 01100001
+	foo.AppendBits(3, 2);		// 11
+
+	puts(foo.ReadAllBits().c_str());	// prints 0000110010000110000111
+
+	// note, since we are two bits short of three bytes, ReadAllBytes()
 	// will pad the result out by adding two extra 0s
 	fstream somefile("c:\some\file");
 	somefile << foo.ReadAllBytes();
+
+	A buffer is either written to (Append functions) or read from, after
+	AssignBytes() (Read, Peek and Skip functions). Reads do not see bits
+	still waiting in the write accumulator. AttachBytes() reads someone
+	else's memory in place instead of taking a copy.
+
+	AppendCodes() is the fast way to write a lot of codes, a letter at a
+	time from a table of their codes:
+
+	TBitBuffer::code_t table[256] = { ... };
+	foo.AppendCodes(text, len, table);
+
+	The bytes come from the memory resource the buffer was made with (the
+	default one unless given), so it can live in an arena:
+
+	std::pmr::monotonic_buffer_resource arena;
+	TBitBuffer bar(&arena);
 */
 #pragma once
-#include <bitset>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <memory_resource>
 #include <string>
+#include <utility>
 
 
 class TBitBuffer {
 
+	public:
+
+		// a code, right aligned in 'bits'
+		struct code_t {
+			uint64_t bits;
+			unsigned int len;
+		};
+		// so a std::pmr container of buffers hands them its resource
+		typedef std::pmr::polymorphic_allocator<char> allocator_type;
+
 	private:
 
-		std::string			bitsBuffer;		// the buffer itself
-		unsigned long		bufferPos;		// used for Read operations
+		// letters AppendCodes() makes room for at a time
+		enum { CODES_CHUNK = 1 << 16 };
+
+		std::pmr::string	bytesBuffer;		// the packed buffer itself
+		uint64_t			accumulator;		// pending bits, right aligned
+		unsigned int		accumulatorBits;	// how many bits are pending
+		uint64_t			bufferPos;			// used for Read operations, in bits
+		const unsigned char	*attached;			// read from here instead, if set
+		size_t				attachedSize;
 
-		// adds one bit to our buffer
-		void _AppendBit(const char bit) { bitsBuffer.append(1, bit); }
-		// returns the next bit from our buffer
-		bool _ReadBit() { return (bitsBuffer.at(bufferPos++) == '1'); }
+		// moves a full accumulator to the byte buffer
+		void				_FlushWord();
+		// returns the 8 bytes at 'pos' as a big endian word, zero filled past the end
+		uint64_t			_LoadWord(size_t) const;
+		// appends the bytes still waiting in the accumulator, zero padded
+		template<class S>
+		void				_AppendTail(S &) const;
+		template<unsigned int PER>
+		void				_AppendCodes(const unsigned char *, size_t, const code_t *, unsigned int);
 
 	public:
 
-		TBitBuffer() { bitsBuffer.clear(); bufferPos = 0; }
-		//~TByteBuffer() { }
+		explicit TBitBuffer(const allocator_type & a = allocator_type()) : bytesBuffer(a) { Clear(); }
+		TBitBuffer(const TBitBuffer & other, const allocator_type & a) : bytesBuffer(a) { *this = other; }
 
-		void					AssignBits(const std::string &);
 		void					AssignBytes(const std::string &);
+		void					AssignBytes(const char *, size_t);
+		// the memory must stay valid until the buffer is cleared
+		void					AttachBytes(const unsigned char *, size_t);
 
-		void					AppendBits(const std::string &);
+		// 'value' holds the code right aligned, up to 64 bits
+		void					AppendBits(uint64_t, unsigned int);
+		void					AppendBuffer(const TBitBuffer &);
 		void					AppendNumber(const unsigned long);
 		void					AppendByte(const char);
-		void					AppendPadding(const unsigned long);
+		// copied straight in when what is already there ends on a byte
+		void					AppendBytes(const unsigned char *, size_t);
+		void					AppendPadding(const uint64_t);
+		// the code of each letter, as AppendBits(table[letter].bits, table[letter].len).
+		// every letter in the input must have a code at least a bit long
+		void					AppendCodes(const unsigned char *, size_t, const code_t *);
 
 		// when calling these Read functions, a position marker is moved
 		// allowing you to read to read the whole stream of bits via
-		// successive calls
-		std::string				ReadBits(const unsigned int);
-		char					ReadBit() { return (_ReadBit() == true) ? '1' : '0'; }
+		// successive calls. PeekBits() does not move the marker and
+		// supports up to 57 bits, ReadBits() up to 64.
+		uint64_t				PeekBits(unsigned int) const;
+		void					SkipBits(unsigned int n) { bufferPos += n; }
+		void					Seek(uint64_t pos) { bufferPos = pos; }
+		uint64_t				ReadBits(unsigned int);
+		bool					ReadBit() { return ReadBits(1) != 0; }
 		unsigned long			ReadNumber();
-		char					ReadByte();
+		char					ReadByte() { return (char)ReadBits(8); }
 		void					ReadPadding();
+		// how far reading has got, in bits, and the bytes being read
+		uint64_t				Position() const { return bufferPos; }
+		const unsigned char		*Data() const { return attached ? attached : (const unsigned char *)bytesBuffer.data(); }
 
 		// these Read functions return the entire contents and do not
 		// alter the position marker for the previous Read functions
-		std::string				ReadAllBits() { return bitsBuffer; }
-		std::string				ReadAllBytes();
+		std::string				ReadAllBits() const;
+		std::string				ReadAllBytes() const;
+
+		// pads what has been written up to a whole byte, after which Bytes()
+		// holds all of it
+		void					Flush();
+		const std::pmr::string	&Bytes() const { return bytesBuffer; }
+		// moves every whole byte written so far to the end of 'out', the
+		// bits of an unfinished byte stay behind
+		void					TakeBytes(std::string &);
 
-		void					Clear() { bitsBuffer.clear(); bufferPos = 0; }
+		void					Clear() { bytesBuffer.clear(); accumulator = 0; accumulatorBits = 0; bufferPos = 0; attached = NULL; attachedSize = 0; }
+		void					Reserve(size_t bytes) { bytesBuffer.reserve(bytes); }
+		// the bytes are copied instead if the two use different resources
+		void					Swap(TBitBuffer &);
 
-		unsigned long			Size() { return bitsBuffer.size() - bufferPos; }
+		uint64_t				Size() const;
 
 };
 
 
-// set the buffer to a string of ones and zeros
-inline void TBitBuffer::AssignBits(const std::string & input)
+// set the buffer using byte data, ready for reading
+inline void TBitBuffer::AssignBytes(const std::string & input)
 {
-	bitsBuffer.assign(input);
-	bufferPos = 0;
+	Clear();
+	bytesBuffer.assign(input);
 }
-// set the buffer using byte data that must be decomposed first
-inline void TBitBuffer::AssignBytes(const std::string & input)
- {
-	bitsBuffer.clear();
-	bufferPos = 0;
-	unsigned char mask = 0x80;
-	unsigned int len = input.size();
-	for(unsigned int i=0;i<len;i++) {
-		char character = input.at(i);
-		for(char j=0;j<8;j++) {
-			char bit = (character & mask) ? '1' : '0';
-			_AppendBit(bit);
-			mask = mask >> 1;
-		}
-		mask = 0x80;
+inline void TBitBuffer::AssignBytes(const char * input, size_t len)
+{
+	Clear();
+	bytesBuffer.assign(input, len);
+}
+inline void TBitBuffer::AttachBytes(const unsigned char * input, size_t len)
+{
+	Clear();
+	attached = input;
+	attachedSize = len;
+}
+
+
+inline uint64_t TBitBuffer::Size() const
+{
+	if(attached != NULL)
+		return (uint64_t)attachedSize*8 - bufferPos;
+	return (uint64_t)bytesBuffer.size()*8 + accumulatorBits - bufferPos;
+}
+inline void TBitBuffer::Flush()
+{
+	_AppendTail(bytesBuffer);
+	accumulator = 0;
+	accumulatorBits = 0;
+}
+inline void TBitBuffer::TakeBytes(std::string & out)
+{
+	out.append(bytesBuffer);
+	bytesBuffer.clear();
+	while(accumulatorBits >= 8) {
+		accumulatorBits -= 8;
+		out.append(1, (char)(accumulator >> accumulatorBits));
 	}
+	accumulator &= ((uint64_t)1 << accumulatorBits) - 1;
+}
+inline void TBitBuffer::Swap(TBitBuffer & other)
+{
+	std::swap(*this, other);
 }
 
 
-// the 'input' string should be some binary value to add to our buffer
-// example: 01000101
-inline void TBitBuffer::AppendBits(const std::string & input)
+inline void TBitBuffer::_FlushWord()
 {
-	bitsBuffer.append(input);
+	char word[8];
+	for(int i=0;i<8;i++)
+		word[i] = (char)(accumulator >> (56 - 8*i));
+	bytesBuffer.append(word, 8);
 }
-// returns as many bits as 'len'
-inline std::string TBitBuffer::ReadBits(const unsigned int len) 
+template<class S>
+inline void TBitBuffer::_AppendTail(S & out) const
 {
-	if(len == 1)
-		return (_ReadBit() == true) ? "1" : "0";
+	if(accumulatorBits == 0) return;
+	uint64_t aligned = accumulator << (64 - accumulatorBits);
+	unsigned int tailBytes = (accumulatorBits + 7) / 8;
+	for(unsigned int i=0;i<tailBytes;i++)
+		out.append(1, (char)(aligned >> (56 - 8*i)));
+}
+inline uint64_t TBitBuffer::_LoadWord(size_t pos) const
+{
+	const unsigned char *p = attached;
+	size_t len = attachedSize;
+	if(p == NULL) {
+		p = (const unsigned char *)bytesBuffer.data();
+		len = bytesBuffer.size();
+	}
+	if(pos + 8 <= len) {
+		p += pos;
+		return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+			((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+			((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+			((uint64_t)p[6] << 8) | (uint64_t)p[7];
+	}
+	// the last few bytes of the buffer
+	uint64_t word = 0;
+	for(size_t i=0;i<8;i++) {
+		word <<= 8;
+		if(pos + i < len) word |= p[pos + i];
+	}
+	return word;
+}
 
-	std::string r = "";
-	for(unsigned int i=0;i<len;i++) {
-		char bit = (_ReadBit() == true) ? '1' : '0';
-		r.append(1, bit);
+
+// add the low 'nbits' of 'value' to our buffer
+// example: AppendBits(5, 4) adds 0101
+inline void TBitBuffer::AppendBits(uint64_t value, unsigned int nbits)
+{
+	if(nbits == 0) return;
+	if(nbits < 64) value &= ((uint64_t)1 << nbits) - 1;
+
+	unsigned int space = 64 - accumulatorBits;
+	if(nbits < space) {
+		accumulator = (accumulator << nbits) | value;
+		accumulatorBits += nbits;
+		return;
+	}
+
+	// fill up the accumulator, flush it, then keep whatever did not fit
+	unsigned int rest = nbits - space;
+	if(space == 64)
+		accumulator = value;
+	else
+		accumulator = (accumulator << space) | (value >> rest);
+	_FlushWord();
+	accumulator = (rest == 0) ? 0 : (value & (((uint64_t)1 << rest) - 1));
+	accumulatorBits = rest;
+}
+/*
+	-- implimentation note --
+	codes are added to a left aligned 64-bit word, every bit under the
+	ones used is 0 so a code only needs shifting into place and OR-ing in.
+	after each flush no more than 7 bits are left, so PER codes of up to
+	'longest' bits can go in one after the other without checking for room,
+	then the whole word is stored and moved along by the whole bytes in it.
+	the buffer is grown a chunk at a time to fit the longest codes, with a
+	word to spare for that store, and cut back to what was used at the end
+*/
+inline void TBitBuffer::AppendCodes(const unsigned char *data, size_t len, const code_t *table)
+{
+	unsigned int longest = 0;
+	for(int i=0;i<256;i++)
+		if(table[i].len > longest) longest = table[i].len;
+
+	switch(56 / (longest ? longest : 56)) {
+		case 1:		_AppendCodes<1>(data, len, table, longest); return;
+		case 2:		_AppendCodes<2>(data, len, table, longest); return;
+		case 3:		_AppendCodes<3>(data, len, table, longest); return;
+		case 0:		break;
+		default:	_AppendCodes<4>(data, len, table, longest); return;
+	}
+	// codes too long for even one to fit after a flush
+	for(size_t i=0;i<len;i++)
+		AppendBits(table[data[i]].bits, table[data[i]].len);
+}
+template<unsigned int PER>
+inline void TBitBuffer::_AppendCodes(const unsigned char *data, size_t len, const code_t *table, unsigned int longest)
+{
+	size_t used = bytesBuffer.size();
+	uint64_t word = (accumulatorBits > 0) ? accumulator << (64 - accumulatorBits) : 0;
+	unsigned int bits = accumulatorBits;
+	unsigned char *p = NULL;
+
+	for(size_t done=0;done<len;) {
+		size_t count = std::min(len - done, (size_t)CODES_CHUNK);
+		bytesBuffer.resize(used + (count * longest + bits) / 8 + 16);
+		p = (unsigned char *)&bytesBuffer[used];
+		const unsigned char *in = data + done;
+		const unsigned char *end = in + count;
+		done += count;
+
+		for(;;) {
+			for(int i=0;i<8;i++)
+				p[i] = (unsigned char)(word >> (56 - 8*i));
+			p += bits >> 3;
+			word <<= bits & ~7u;
+			bits &= 7;
+			if(end - in < (ptrdiff_t)PER) break;
+			for(unsigned int k=0;k<PER;k++) {
+				const code_t & code = table[*in++];
+				bits += code.len;
+				word |= code.bits << (64 - bits);
+			}
+		}
+		// the last few letters of the chunk
+		for(;in<end;in++) {
+			const code_t & code = table[*in];
+			bits += code.len;
+			word |= code.bits << (64 - bits);
+			for(int i=0;i<8;i++)
+				p[i] = (unsigned char)(word >> (56 - 8*i));
+			p += bits >> 3;
+			word <<= bits & ~7u;
+			bits &= 7;
+		}
+		used = p - (unsigned char *)bytesBuffer.data();
+	}
+	bytesBuffer.resize(used);
+
+	accumulator = (bits > 0) ? word >> (64 - bits) : 0;
+	accumulatorBits = bits;
+}
+// append everything written to another buffer
+inline void TBitBuffer::AppendBuffer(const TBitBuffer & other)
+{
+	const std::pmr::string & bytes = other.bytesBuffer;
+	size_t len = bytes.size();
+	size_t i = 0;
+	for(;i+8<=len;i+=8)
+		AppendBits(other._LoadWord(i), 64);
+	for(;i<len;i++)
+		AppendBits((unsigned char)bytes[i], 8);
+	AppendBits(other.accumulator, other.accumulatorBits);
+}
+// returns the next 'len' bits without moving the position marker
+inline uint64_t TBitBuffer::PeekBits(const unsigned int len) const
+{
+	if(len == 0) return 0;
+	uint64_t word = _LoadWord((size_t)(bufferPos >> 3)) << (bufferPos & 7);
+	return word >> (64 - len);
+}
+// returns as many bits as 'len'
+inline uint64_t TBitBuffer::ReadBits(const unsigned int len)
+{
+	if(len > 57) {
+		uint64_t high = ReadBits(len - 32);
+		return (high << 32) | ReadBits(32);
 	}
+	uint64_t r = PeekBits(len);
+	bufferPos += len;
 	return r;
 }
 
@@ -137,22 +382,22 @@ inline std::string TBitBuffer::ReadBits(const unsigned int len)
 */
 inline void TBitBuffer::AppendNumber(const unsigned long value)
 {
-	unsigned int a = value / 5;
-	unsigned int b = value % 5;
-	for(unsigned int i=0;i<a;i++)
-		_AppendBit('1');
-	_AppendBit('0');
-	for(unsigned int i=0;i<b;i++)
-		_AppendBit('1');
-	_AppendBit('0');
+	unsigned long tallies[2] = { value / 5, value % 5 };
+	for(int t=0;t<2;t++) {
+		unsigned long a = tallies[t];
+		for(;a>=32;a-=32)
+			AppendBits(0xFFFFFFFF, 32);
+		// 'a' ones followed by the zero terminator
+		AppendBits((((uint64_t)1 << a) - 1) << 1, a + 1);
+	}
 }
 // returns a number made up by AppendNumber()
 inline unsigned long TBitBuffer::ReadNumber()
 {
 	unsigned int a = 0, b = 0;
-	while(_ReadBit() != false)
+	while(ReadBit() != false)
 		a++;
-	while(_ReadBit() != false)
+	while(ReadBit() != false)
 		b++;
 	return (a*5)+b;
 }
@@ -160,70 +405,61 @@ inline unsigned long TBitBuffer::ReadNumber()
 
 // add some bits to pad the total stream so it is aligned to 8 bits
 // padding is made up of 0's then a 1 to mark the end
-inline void TBitBuffer::AppendPadding(const unsigned long totalSize)
-{
-	unsigned int paddingSize = totalSize % 8;
-	paddingSize = 8 - paddingSize;
-	if(paddingSize < 8) {
-		paddingSize--;		// leave space for the '1'
-		for(unsigned char i=0;i<paddingSize;i++)
-			_AppendBit('0');
-	} else {
-		/*
-		- !! worst case scenario !! -
-		the block doesn't require padding! gagh!
-		but we *must* add the '1' bit to mark the end of padding
-		thus we end up writing a *byte*, just to store the *1 bit* :(
-		*/
-		for(unsigned char i=0;i<7;i++)
-			_AppendBit('0');
-	}
-	_AppendBit('1');		// end of padding marker
+inline void TBitBuffer::AppendPadding(const uint64_t totalSize)
+{
+	unsigned int paddingSize = 8 - (totalSize % 8);
+	/*
+	- !! worst case scenario !! -
+	when the block doesn't require padding (paddingSize is 8) we still
+	*must* add the '1' bit to mark the end of padding, thus we end up
+	writing a *byte*, just to store the *1 bit* :(
+	*/
+	AppendBits(1, paddingSize);		// 0's then the end of padding marker
 }
 // this just moves the pointer past the padding
 inline void TBitBuffer::ReadPadding()
 {
 	for(unsigned char i=0;i<8;i++)
-		if(_ReadBit() == true) break;
+		if(ReadBit() == true) break;
 }
 
 
 inline void TBitBuffer::AppendByte(const char input)
 {
-	unsigned char mask = 0x80;		// 10000000
-	//for(int i=7;i>=0;i--) {
-	for(int i=0;i<8;i++) {
-		char bit = (input & mask) ? '1' : '0';
-		_AppendBit(bit);
-		mask = mask >> 1;			// 01000000 and so on
-	}
+	AppendBits((unsigned char)input, 8);
 }
-// returns a single byte
-inline char TBitBuffer::ReadByte()
+inline void TBitBuffer::AppendBytes(const unsigned char *data, size_t len)
 {
-	// get a byte
-	std::bitset<8> byte;
-	for(int i=0;i<8;i++)
-		byte.set((7-i), _ReadBit());
-	return (char)byte.to_ulong();
+	if(accumulatorBits % 8 != 0) {
+		for(size_t i=0;i<len;i++)
+			AppendBits(data[i], 8);
+		return;
+	}
+	_AppendTail(bytesBuffer);
+	accumulator = 0;
+	accumulatorBits = 0;
+	bytesBuffer.append((const char *)data, len);
 }
 
 
-// translate a string of binary to real binary bytes
-// will be padded up to nearest byte if too short
-inline std::string TBitBuffer::ReadAllBytes()
+// a string of ones and zeros, handy for debugging
+inline std::string TBitBuffer::ReadAllBits() const
 {
-	unsigned long bufferSize = bitsBuffer.size();
-	std::string bytes = "";
-	std::bitset<8> byte;
-	// move through the string in byte chunks
-	for(unsigned int i=0;i<bufferSize;i+=8) {
-		byte.reset();
-		for(unsigned char j=0;j<8;j++) {
-			if((i+j) >= bufferSize) break;
-			byte.set((7-j), (bitsBuffer.at(i+j) == '1'));
-		}
-		bytes.append(1, (char)byte.to_ulong());
-	}
+	std::string r = "";
+	size_t len = bytesBuffer.size();
+	for(size_t i=0;i<len;i++)
+		for(int j=7;j>=0;j--)
+			r.append(1, ((bytesBuffer[i] >> j) & 1) ? '1' : '0');
+	for(int j=(int)accumulatorBits-1;j>=0;j--)
+		r.append(1, ((accumulator >> j) & 1) ? '1' : '0');
+	return r;
+}
+// the packed bytes, padded up to the nearest byte if too short
+inline std::string TBitBuffer::ReadAllBytes() const
+{
+	std::string bytes;
+	bytes.reserve(bytesBuffer.size() + 8);
+	bytes.assign(bytesBuffer);
+	_AppendTail(bytes);
 	return bytes;
 }
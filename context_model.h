@@ -0,0 +1,209 @@
+// context_model.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - TContextModel
+	Counts each letter by the letter in front of it (its context), then
+	groups contexts that are followed by similar letters so they can share
+	a code table. Text like logs and CSV files is much easier to predict
+	from the previous letter, but a table for every context would cost
+	more to store than it saves, so contexts are only kept apart while
+	that pays for the extra table.
+
+	Usage Example:
+
+	TContextModel model;
+	model.Count(data, len);
+	model.Cluster();
+	for(unsigned int t=0;t<model.Tables();t++)
+		BuildCodesFrom(model.Counts(t));
+	unsigned int table = model.Map()[previousLetter];
+*/
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <memory_resource>
+#include <vector>
+#include "histogram.h"
+
+
+class TContextModel {
+
+	public:
+
+		// most tables a message can have, so a table number fits in 4 bits
+		enum { MAX_TABLES = 16 };
+
+	private:
+
+		// the busiest contexts start off in their own group, the rest
+		// start off together. keeps the grouping quick
+		enum { SEEDS = 64 };
+
+		std::pmr::vector<THistogram>	contexts;		// by previous letter
+		std::pmr::vector<THistogram>	groups;
+		unsigned char			map[256];		// context to group
+
+		static double			_Cost(const THistogram &);
+		static double			_MergedCost(const THistogram &, const THistogram &);
+
+	public:
+
+		typedef std::pmr::polymorphic_allocator<char> allocator_type;
+
+		// the counts and Cluster()'s working space come from 'a'
+		explicit TContextModel(const allocator_type & a = allocator_type()) : contexts(a), groups(a) { Clear(); }
+
+		void					Clear();
+		// counts pairs of letters, the first letter's context is letter 0
+		void					Count(const unsigned char *, size_t);
+		// groups the contexts, after which there are Tables() of them
+		void					Cluster();
+
+		unsigned int			Tables() const { return groups.size(); }
+		const THistogram		&Counts(unsigned int table) const { return groups[table]; }
+		// the table each context uses. contexts never seen use table 0
+		const unsigned char		*Map() const { return map; }
+
+		// what a table of these counts costs to store in a header, in bits
+		static uint64_t			TableBits(const THistogram &);
+
+};
+
+
+inline void TContextModel::Clear()
+{
+	contexts.resize(256);
+	for(int i=0;i<256;i++)
+		contexts[i].Clear();
+	groups.clear();
+	for(int i=0;i<256;i++)
+		map[i] = 0;
+}
+inline void TContextModel::Count(const unsigned char *data, size_t len)
+{
+	unsigned char previous = 0;
+	for(size_t i=0;i<len;i++) {
+		contexts[previous].Add(data[i], 1);
+		previous = data[i];
+	}
+}
+
+
+// the same run length tokens as THuffman's header, 6 bits a letter with
+// a code and 14 bits a run of letters without
+inline uint64_t TContextModel::TableBits(const THistogram & counts)
+{
+	uint64_t r = 0;
+	for(int i=0;i<256;) {
+		if(counts[i] > 0) {
+			r += 6;
+			i++;
+			continue;
+		}
+		while(i < 256 && counts[i] == 0) i++;
+		r += 14;
+	}
+	return r;
+}
+// about what coding these counts with their own table costs: the entropy
+// of the letters plus the table itself
+inline double TContextModel::_Cost(const THistogram & counts)
+{
+	uint64_t total = counts.Total();
+	if(total == 0) return 0;
+	double r = total * log2((double)total);
+	for(int i=0;i<256;i++)
+		if(counts[i] > 0) r -= counts[i] * log2((double)counts[i]);
+	return r + TableBits(counts);
+}
+inline double TContextModel::_MergedCost(const THistogram & a, const THistogram & b)
+{
+	THistogram merged = a;
+	merged.Add(b);
+	return _Cost(merged);
+}
+
+
+/*
+	-- implimentation note --
+	starting with a group per context, keep merging the two groups whose
+	merging adds the fewest bits (or saves the most, one table less) until
+	no merge saves anything and there are no more than MAX_TABLES groups
+*/
+inline void TContextModel::Cluster()
+{
+	std::pmr::memory_resource *resource = contexts.get_allocator().resource();
+	std::pmr::vector<unsigned int> seen(resource);
+	seen.reserve(256);
+	for(unsigned int i=0;i<256;i++)
+		if(contexts[i].Total() > 0) seen.push_back(i);
+	// ties stay in context order, as stable_sort() would leave them but
+	// without its scratch buffer
+	std::sort(seen.begin(), seen.end(), [&](unsigned int a, unsigned int b)
+		{ return contexts[a].Total() > contexts[b].Total() || (contexts[a].Total() == contexts[b].Total() && a < b); });
+
+	unsigned int owner[256] = { 0 };
+	groups.clear();
+	for(size_t i=0;i<seen.size();i++) {
+		if(i < SEEDS) groups.push_back(contexts[seen[i]]);
+		else groups.back().Add(contexts[seen[i]]);
+		owner[seen[i]] = groups.size() - 1;
+	}
+	if(groups.empty()) groups.resize(1);
+
+	size_t n = groups.size();
+	std::pmr::vector<double> cost(n, resource);
+	for(size_t i=0;i<n;i++)
+		cost[i] = _Cost(groups[i]);
+	// what merging i and j would add, only i < j is kept up to date
+	std::pmr::vector<double> delta(n * n, resource);
+	for(size_t i=0;i<n;i++)
+		for(size_t j=i+1;j<n;j++)
+			delta[i*n + j] = _MergedCost(groups[i], groups[j]) - cost[i] - cost[j];
+
+	size_t count = n;
+	while(count > 1) {
+		size_t bestI = 0, bestJ = 1;
+		for(size_t i=0;i<count;i++)
+			for(size_t j=i+1;j<count;j++)
+				if(delta[i*n + j] < delta[bestI*n + bestJ]) {
+					bestI = i;
+					bestJ = j;
+				}
+		if(count <= MAX_TABLES && delta[bestI*n + bestJ] >= 0) break;
+
+		// merge j into i, then move the last group into j's place
+		groups[bestI].Add(groups[bestJ]);
+		cost[bestI] = _Cost(groups[bestI]);
+		size_t last = count - 1;
+		for(int c=0;c<256;c++) {
+			if(owner[c] == bestJ) owner[c] = bestI;
+			if(owner[c] == last) owner[c] = bestJ;
+		}
+		if(bestJ != last) {
+			groups[bestJ] = groups[last];
+			cost[bestJ] = cost[last];
+		}
+		count--;
+
+		for(size_t k=0;k<count;k++) {
+			if(k == bestI) continue;
+			size_t i = std::min(k, bestI), j = std::max(k, bestI);
+			delta[i*n + j] = _MergedCost(groups[i], groups[j]) - cost[i] - cost[j];
+		}
+		if(bestJ != last) {
+			for(size_t k=0;k<count;k++) {
+				if(k == bestJ) continue;
+				size_t i = std::min(k, bestJ), j = std::max(k, bestJ);
+				delta[i*n + j] = _MergedCost(groups[i], groups[j]) - cost[i] - cost[j];
+			}
+		}
+	}
+	groups.resize(count);
+
+	for(int c=0;c<256;c++)
+		map[c] = (unsigned char)owner[c];
+}
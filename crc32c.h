@@ -0,0 +1,112 @@
+// crc32c.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - CRC32C
+	The Castagnoli CRC, used to check that a decoded block matches what was
+	encoded. x86 processors since SSE4.2 have an instruction for it, which
+	is used when the processor has it. Otherwise it is worked out 8 bytes
+	at a time from tables (slicing-by-8), which the compiler builds.
+
+	Usage Example:
+
+	uint32_t crc = Crc32c((const unsigned char *)"1234", 4);
+	crc = Crc32c((const unsigned char *)"56789", 5, crc);
+	// crc is now 0xE3069283, the same as all 9 bytes in one go
+*/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#include <nmmintrin.h>
+	#define CRC32C_HARDWARE __attribute__((target("sse4.2")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+	#include <intrin.h>
+	#include <nmmintrin.h>
+	#define CRC32C_HARDWARE
+#endif
+
+
+struct TCrc32cTables {
+	// table[k][b] is the crc of byte b followed by k zero bytes
+	uint32_t table[8][256];
+};
+
+constexpr TCrc32cTables __Crc32cBuildTables()
+{
+	TCrc32cTables r = {};
+	for(unsigned int b=0;b<256;b++) {
+		uint32_t crc = b;
+		for(int i=0;i<8;i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+		r.table[0][b] = crc;
+	}
+	for(unsigned int b=0;b<256;b++)
+		for(int k=1;k<8;k++)
+			r.table[k][b] = (r.table[k-1][b] >> 8) ^ r.table[0][r.table[k-1][b] & 0xFF];
+	return r;
+}
+static constexpr TCrc32cTables CRC32C_TABLES = __Crc32cBuildTables();
+
+
+// the crc without the pre and post inversion, 8 bytes per step
+inline uint32_t __Crc32cSoftware(uint32_t crc, const unsigned char *data, size_t len)
+{
+	const uint32_t (*t)[256] = CRC32C_TABLES.table;
+	for(;len>=8;len-=8,data+=8) {
+		uint32_t low = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+		crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+			t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+	}
+	for(;len>0;len--,data++)
+		crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+	return crc;
+}
+
+
+#if defined(CRC32C_HARDWARE)
+CRC32C_HARDWARE inline uint32_t __Crc32cHardware(uint32_t crc, const unsigned char *data, size_t len)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	uint64_t crc64 = crc;
+	for(;len>=8;len-=8,data+=8) {
+		uint64_t word;
+		memcpy(&word, data, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = (uint32_t)crc64;
+#endif
+	for(;len>=4;len-=4,data+=4) {
+		uint32_t word;
+		memcpy(&word, data, 4);
+		crc = _mm_crc32_u32(crc, word);
+	}
+	for(;len>0;len--,data++)
+		crc = _mm_crc32_u8(crc, *data);
+	return crc;
+}
+inline bool __Crc32cHardwareSupported()
+{
+#if defined(__GNUC__)
+	static const bool supported = __builtin_cpu_supports("sse4.2");
+#else
+	static const bool supported = [] { int info[4]; __cpuid(info, 1); return (info[2] & (1 << 20)) != 0; }();
+#endif
+	return supported;
+}
+#endif
+
+
+// the crc of 'len' bytes, carrying on from 'crc' if they follow on from
+// bytes already checked
+inline uint32_t Crc32c(const unsigned char *data, size_t len, uint32_t crc = 0)
+{
+	crc = ~crc;
+#if defined(CRC32C_HARDWARE)
+	if(__Crc32cHardwareSupported())
+		return ~__Crc32cHardware(crc, data, len);
+#endif
+	return ~__Crc32cSoftware(crc, data, len);
+}
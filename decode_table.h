@@ -0,0 +1,180 @@
+// decode_table.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - TDecodeTable
+	A flat lookup table for decoding huffman codes several bits at a time.
+	The next 'primaryBits' bits of the stream index straight into the table,
+	each entry gives the letter and how long its code really is. Codes longer
+	than 'primaryBits' land on an entry pointing at a secondary table which is
+	indexed by the bits that follow, and so on.
+
+	Usage Example:
+
+	TDecodeTable table;
+	table.Add('a', 0, 1);		// a = 0
+	table.Add('b', 2, 2);		// b = 10
+	table.Add('c', 3, 2);		// c = 11
+	table.Build();
+
+	// or the same thing from canonical code lengths
+	unsigned char lengths[256] = { 0 };
+	lengths['a'] = 1; lengths['b'] = 2; lengths['c'] = 2;
+	table.Build(lengths);
+
+	while(bits.Size() > 0)
+		putchar(table.Decode(bits));
+
+	Like TBitBuffer, a table can be given a memory resource to build in.
+*/
+#pragma once
+#include <stdint.h>
+#include <memory_resource>
+#include <vector>
+#include "bit_buffer.h"
+#include "huffman_codes.h"
+
+
+class TDecodeTable {
+
+	public:
+
+		struct entry_t {
+			unsigned int value;			// the letter, or where the secondary table starts
+			unsigned char len;			// bits used by this entry, 0 for an unused slot
+			unsigned char subBits;		// non-zero if 'value' is a secondary table of this many bits
+		};
+
+	private:
+
+		struct code_t {
+			uint64_t bits;
+			unsigned char letter;
+			unsigned char len;
+		};
+
+		unsigned int				primaryBits;
+		std::pmr::vector<code_t>	codes;
+		std::pmr::vector<entry_t>	table;		// primary table, followed by the secondary tables
+
+		unsigned int			_BuildLevel(const std::pmr::vector<code_t> &, unsigned int, unsigned int);
+
+	public:
+
+		typedef std::pmr::polymorphic_allocator<char> allocator_type;
+
+		TDecodeTable(unsigned int bits = 11, const allocator_type & a = allocator_type()) : codes(a), table(a) { primaryBits = bits; }
+		explicit TDecodeTable(const allocator_type & a) : codes(a), table(a) { primaryBits = 11; }
+		TDecodeTable(const TDecodeTable & other, const allocator_type & a) : codes(a), table(a) { *this = other; }
+
+		void					Clear() { codes.clear(); table.clear(); }
+		void					Add(unsigned char, uint64_t, unsigned int);
+		void					Build();
+		// builds the table for the canonical codes of these lengths
+		void					Build(const unsigned char *);
+
+		// decodes one letter from the current position of 'bits'
+		// returns false if the bits do not match any code
+		bool					Decode(TBitBuffer &, unsigned char &) const;
+		char					Decode(TBitBuffer &) const;
+
+		unsigned int			Size() const { return codes.size(); }
+
+};
+
+
+// remember a code, the table is made by Build() once all codes are known
+inline void TDecodeTable::Add(unsigned char letter, uint64_t bits, unsigned int len)
+{
+	code_t code;
+	code.bits = bits;
+	code.letter = letter;
+	code.len = len;
+	codes.push_back(code);
+}
+
+
+inline void TDecodeTable::Build()
+{
+	table.clear();
+	_BuildLevel(codes, 0, primaryBits);
+}
+inline void TDecodeTable::Build(const unsigned char *lengths)
+{
+	uint64_t canonical[256];
+	CanonicalCodes(lengths, canonical);
+	codes.clear();
+	for(int i=0;i<256;i++)
+		if(lengths[i] > 0)
+			Add((unsigned char)i, canonical[i], lengths[i]);
+	Build();
+}
+// fill in a table of 2^bits entries for 'levelCodes', which have already had
+// 'consumed' bits used up by the tables above. returns where the table starts
+inline unsigned int TDecodeTable::_BuildLevel(const std::pmr::vector<code_t> & levelCodes, unsigned int consumed, unsigned int bits)
+{
+	unsigned int start = table.size();
+	entry_t unused = { 0, 0, 0 };
+	table.resize(start + (1 << bits), unused);
+
+	// codes too long for this table, grouped by the slot they pass through
+	std::pmr::vector< std::pmr::vector<code_t> > longer(table.get_allocator());
+
+	size_t count = levelCodes.size();
+	for(size_t i=0;i<count;i++) {
+		const code_t & code = levelCodes[i];
+		unsigned int remaining = code.len - consumed;
+		uint64_t remainingBits = code.bits & (((uint64_t)1 << remaining) - 1);
+		if(remaining <= bits) {
+			// every slot starting with this code decodes to the letter
+			unsigned int first = (unsigned int)(remainingBits << (bits - remaining));
+			unsigned int last = first + (1 << (bits - remaining));
+			for(unsigned int j=first;j<last;j++) {
+				table[start + j].value = code.letter;
+				table[start + j].len = remaining;
+				table[start + j].subBits = 0;
+			}
+		} else {
+			unsigned int slot = (unsigned int)(remainingBits >> (remaining - bits));
+			if(longer.empty()) longer.resize(1 << bits);
+			longer[slot].push_back(code);
+		}
+	}
+
+	// now the secondary tables, each only as wide as its longest code needs
+	for(size_t slot=0;slot<longer.size();slot++) {
+		if(longer[slot].empty()) continue;
+		unsigned int subBits = 0;
+		for(size_t i=0;i<longer[slot].size();i++)
+			if(longer[slot][i].len - consumed - bits > subBits)
+				subBits = longer[slot][i].len - consumed - bits;
+		if(subBits > primaryBits) subBits = primaryBits;
+		unsigned int subStart = _BuildLevel(longer[slot], consumed + bits, subBits);
+		table[start + slot].value = subStart;
+		table[start + slot].len = bits;
+		table[start + slot].subBits = subBits;
+	}
+
+	return start;
+}
+
+
+inline bool TDecodeTable::Decode(TBitBuffer & bits, unsigned char & letter) const
+{
+	const entry_t *entry = &table[bits.PeekBits(primaryBits)];
+	while(entry->subBits) {
+		bits.SkipBits(entry->len);
+		entry = &table[entry->value + bits.PeekBits(entry->subBits)];
+	}
+	if(entry->len == 0) return false;
+	bits.SkipBits(entry->len);
+	letter = (unsigned char)entry->value;
+	return true;
+}
+inline char TDecodeTable::Decode(TBitBuffer & bits) const
+{
+	unsigned char letter = 0;
+	Decode(bits, letter);
+	return (char)letter;
+}
@@ -0,0 +1,158 @@
+// histogram.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - THistogram
+	Counts how often each byte value appears. Counting is spread over
+	several interleaved sets of counters, so a run of the same byte does not
+	make every increment wait on the one before it. Large inputs can also be
+	split over a TWorkerPool, each worker counting its own slice before the
+	results are added together. Counting can also work out a CRC32C of the
+	bytes as it goes (see crc32c.h), a piece at a time while each piece is
+	still in the cache from being counted.
+
+	Usage Example:
+
+	THistogram hist;
+	hist.Count((const unsigned char *)text.data(), text.size());
+	printf("%u different letters, %u e's\n", hist.Symbols(), (unsigned int)hist['e']);
+*/
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <memory_resource>
+#include <vector>
+#include "crc32c.h"
+#include "worker_pool.h"
+
+
+class THistogram {
+
+	private:
+
+		enum { LANES = 4 };
+
+		uint64_t			counts[256];
+
+	public:
+
+		// below this, splitting the work over threads costs more than it
+		// saves, so the pool's Count() counts on the calling thread
+		enum { PARALLEL_MIN_BYTES = 4 << 20 };
+		// small enough to still be in the L1 cache when the crc reads it.
+		// the decoder checks the letters it writes in pieces this size too
+		enum { CRC_PIECE = 16 << 10 };
+
+		THistogram() { Clear(); }
+
+		void				Clear() { memset(counts, 0, sizeof(counts)); }
+
+		// adds the bytes to the counts. with 'crc', also carries it on
+		// over them, as Crc32c() would
+		void				Count(const unsigned char *, size_t, uint32_t *crc = NULL);
+		// split between the workers, whose counts are kept in the memory
+		// resource given until they are added up
+		void				Count(const unsigned char *, size_t, TWorkerPool &, std::pmr::memory_resource * = std::pmr::get_default_resource());
+		void				Add(unsigned char letter, uint64_t n) { counts[letter] += n; }
+		void				Add(const THistogram &);
+
+		uint64_t			operator[](unsigned char letter) const { return counts[letter]; }
+		const uint64_t		*Counts() const { return counts; }
+		unsigned int		Symbols() const;		// how many letters were seen
+		uint64_t			Total() const;
+		// the fewest bits one code table could code these letters in
+		double				EntropyBits() const;
+
+};
+
+
+inline void THistogram::Count(const unsigned char *data, size_t len, uint32_t *crc)
+{
+	// 32 bit lanes keep the working set at 4KB, so flush them into the
+	// 64 bit totals well before they could overflow
+	uint32_t lanes[LANES][256];
+	memset(lanes, 0, sizeof(lanes));
+
+	size_t piece = crc ? (size_t)CRC_PIECE : ((size_t)1 << 30), unflushed = 0;
+	while(len > 0) {
+		size_t chunk = (len < piece) ? len : piece;
+		size_t i = 0;
+		// 8 bytes per load, each byte to the next lane
+		for(;i+8<=chunk;i+=8) {
+			uint64_t word;
+			memcpy(&word, data + i, 8);
+			lanes[0][(unsigned char)(word)]++;
+			lanes[1][(unsigned char)(word >> 8)]++;
+			lanes[2][(unsigned char)(word >> 16)]++;
+			lanes[3][(unsigned char)(word >> 24)]++;
+			lanes[0][(unsigned char)(word >> 32)]++;
+			lanes[1][(unsigned char)(word >> 40)]++;
+			lanes[2][(unsigned char)(word >> 48)]++;
+			lanes[3][(unsigned char)(word >> 56)]++;
+		}
+		for(;i<chunk;i++)
+			lanes[0][data[i]]++;
+		if(crc) *crc = Crc32c(data, chunk, *crc);
+
+		unflushed += chunk;
+		if(chunk == len || unflushed + piece > ((size_t)1 << 30)) {
+			for(int l=0;l<LANES;l++)
+				for(int j=0;j<256;j++) {
+					counts[j] += lanes[l][j];
+					lanes[l][j] = 0;
+				}
+			unflushed = 0;
+		}
+		data += chunk;
+		len -= chunk;
+	}
+}
+// split the bytes into one slice per worker
+inline void THistogram::Count(const unsigned char *data, size_t len, TWorkerPool & pool, std::pmr::memory_resource *resource)
+{
+	if(pool.Size() == 1 || len < PARALLEL_MIN_BYTES) {
+		Count(data, len);
+		return;
+	}
+
+	std::pmr::vector<THistogram> parts(pool.Size(), resource);
+	size_t slice = (len + parts.size() - 1) / parts.size();
+	pool.Run(parts.size(), [&](size_t i, unsigned int) {
+		size_t start = i * slice;
+		if(start >= len) return;
+		size_t end = (start + slice < len) ? start + slice : len;
+		parts[i].Count(data + start, end - start);
+	});
+	for(size_t i=0;i<parts.size();i++)
+		Add(parts[i]);
+}
+
+
+inline void THistogram::Add(const THistogram & other)
+{
+	for(int i=0;i<256;i++)
+		counts[i] += other.counts[i];
+}
+inline unsigned int THistogram::Symbols() const
+{
+	unsigned int r = 0;
+	for(int i=0;i<256;i++)
+		if(counts[i] > 0) r++;
+	return r;
+}
+inline uint64_t THistogram::Total() const
+{
+	uint64_t r = 0;
+	for(int i=0;i<256;i++)
+		r += counts[i];
+	return r;
+}
+inline double THistogram::EntropyBits() const
+{
+	double total = (double)Total(), r = 0;
+	for(int i=0;i<256;i++)
+		if(counts[i] > 0) r += counts[i] * log2(total / counts[i]);
+	return r;
+}
@@ -7,8 +7,10 @@
 	The main class. Converts plain text to huffman encoded strings and
 	visa-versa.
 
-	Limitations: The header produced is quite large and so currently not
-	suitable on very short strings with low repetition.
+	Limitations: The header produced is still around 20-60 bytes and so
+	currently not suitable on very short strings with low repetition. Those
+	(and anything else coding would barely shrink) are stored as they are,
+	one byte longer than they started.
 
 	Usage Example:
 
@@ -21,168 +23,1082 @@
 
 	huff.Encode("c:\some\plain.file", "c:\some\encoded.file");
 	huff.Decode("c:\some\encoded.file", "c:\some\decoded.file");
+
+	Files are encoded in blocks (see huffman_frame.h) so memory use stays
+	around a few times SetBlockSize() however large the file is. Blocks are
+	independent of each other, so with SetThreads() several are encoded at
+	once. With SetSeekTable() the file also records where each block is,
+	so DecodeRange() can go straight to the blocks it needs. The mapped and
+	pipelined decoders find the blocks as they go, and only the stream
+	decoder, without SetPipeline(), needs the table to use SetThreads().
+
+	Where memory mapped files are available, the filename versions read the
+	input in place and write the output without copying it through any
+	stream or string buffers.
+
+	With SetChecksums() each block of a file also carries a CRC32C of its
+	letters. Decoding checks them, carries on past a block that does not
+	match, and returns 8 at the end with GetBadBlocks() saying which.
+
+	DecodeRange() decodes just some bytes of an encoded file, reading only
+	the blocks that hold them. Files with a seek table also record points
+	every SetSyncInterval() letters where decoding can start part way
+	through a block, so only a little either side of the range is decoded.
+
+	The buffers and scratch space of the in-memory calls (Encode() and
+	Decode() of strings, preset messages and batches) come from the
+	std::pmr::memory_resource the THuffman was made with, so a service can
+	give each request an arena:
+
+	std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+	THuffman coder(&arena);
+	string encoded = coder.Encode(message);
+
+	The strings handed back, the tables inside presets, the threads
+	SetThreads() starts and the file calls still use the default resource.
+
+	Nothing is printed. SetCollectStats() fills in a THuffmanStats on each
+	call instead (see huffman_stats.h).
 */
 #pragma once
+#include <stdio.h>
+#include <string.h>
 #include <fstream>
 #include <string>
 #include <map>
+#include <memory_resource>
 #include <vector>
 #include <algorithm>
+#include <functional>
 #include "bit_buffer.h"
+#include "context_model.h"
+#include "crc32c.h"
+#include "decode_table.h"
+#include "huffman_batch.h"
 #include "huffman_btree.h"
+#include "huffman_codes.h"
+#include "huffman_frame.h"
+#include "huffman_preset.h"
+#include "huffman_stats.h"
+#include "histogram.h"
+#include "mapped_file.h"
+#include "pipeline.h"
+#include "worker_pool.h"
 
 
 class THuffman {
 
 	private:
 
+		// first byte of every encoded message. version 1 (the original
+		// format) started with the letter count and stored each code in full.
+		// version 3 is version 2 with the body split into STREAMS substreams,
+		// version 4 has a table per group of contexts (see SetContexts()),
+		// version 5 is the letters stored as they are (see SetMinSaving()),
+		// version 6 codes the body with the table of the message before
+		// (see SetReuseTables())
+		enum { HEADER_VERSION = 2, HEADER_VERSION_STREAMS = 3, HEADER_VERSION_CONTEXTS = 4, HEADER_VERSION_STORED = 5, HEADER_VERSION_REPEAT = 6 };
+		enum { STREAMS = 4 };
+		// below this many letters the substream sizes cost more than
+		// decoding them side by side saves
+		enum { STREAMS_MIN_LETTERS = 4096 };
+		// or from tables for each context
+		enum { CONTEXTS_MIN_LETTERS = 4096 };
+
+		// a huffman code, right aligned in 'bits'
+		typedef TBitBuffer::code_t code_t;
+
 		// -- for encoding only:
-		std::vector<THuffmanBTree*> forest;
-		std::map<const char, TBitBuffer*> bitTable;
-		// freqTable is a convenience for constructing the header
-		std::map<const char, unsigned long> freqTable;
+		// every node lives in 'tree', which is reused for each message.
+		// 'forest' holds the nodes that are still roots of their own trees
+		THuffmanBTree tree;
+		std::pmr::vector<unsigned short> forest;
+		code_t bitTable[256];				// by letter, len 0 if it has no code
+		// how often each letter appears, the forest is grown from this
+		THistogram freqTable;
 		// -- for decoding only:
-		std::map<const std::string, const char> codeTable;	// reverse of bitTable
-		std::map<const std::string, const char> codeTableCache;
+		TDecodeTable codeTable;		// reverse of bitTable, kept between messages
+		bool haveTable;				// set once codeTable holds a table from a header
+		// -- for encoding only: the text being encoded, wherever it lives
+		const unsigned char *plainData;
+		unsigned long plainSize;
 		// -- both modes:
-		std::string plainText;
+		unsigned char codeLengths[256];		// canonical codes are built from these
+		// set when the body of this message is split into substreams,
+		// the first STREAMS-1 sizes are stored, the last is what is left
+		bool streamed;
+		uint64_t streamLetters;
+		uint64_t streamBytes[STREAMS];
+		std::pmr::vector<TBitBuffer> streams;		// STREAMS of them
+		// set when this message has a table for each group of contexts,
+		// 'contextMap' says which table follows each letter
+		bool contextMode;
+		unsigned int contextTables;
+		unsigned char contextMap[256];
+		unsigned char contextLengths[TContextModel::MAX_TABLES][256];
+		uint64_t contextCodes[TContextModel::MAX_TABLES][256];		// encoding
+		std::pmr::vector<TDecodeTable> contextDecoders;		// decoding, MAX_TABLES of them
+		TContextModel contextModel;
+		// set when this message is stored rather than coded
+		bool stored;
+		double minSaving;
+		unsigned int maxCodeLength;
+		std::pmr::string plainText;
 		TBitBuffer encodedText;
+		TBitBuffer bodyText;		// kept so its memory is reused
+		// -- files:
+		unsigned long blockSize;
+		unsigned int threads;
+		bool seekTable;
+		bool interleave;
+		bool contexts;
+		bool pipeline;
+		bool checksums;
+		// -- reusing tables, see SetReuseTables():
+		bool reuseTables;
+		// set while every block of a file goes through this coder in order,
+		// then each can be coded with the last table that was sent
+		bool chainTables;
+		bool repeated;					// this message uses that table
+		bool haveSent;
+		code_t sentTable[256];
+		unsigned char sentLengths[256];
+		// -- sync points, see SetSyncInterval():
+		uint32_t syncInterval;
+		uint32_t syncEvery;				// while encoding a file with a seek table
+		std::pmr::vector<uint64_t> syncBits;	// of the last message encoded
+		std::vector<uint64_t> badBlocks;		// of the last file decoded
+		// set while Encode() has threads to spare for counting a big input
+		TWorkerPool *pool;
+		// -- trained tables, by id
+		std::pmr::map<unsigned int, THuffmanPreset> presets;
+		// -- statistics, only gathered when asked for:
+		bool collectStats;
+		THuffmanStats stats;
+		std::function<void(const THuffmanStats &)> statsCallback;
 
 
 		// high-level private functions
+		// into encodedText, and the checksum of the letters into 'crc'
+		void					_Encode(const unsigned char *, unsigned long, uint32_t *crc = NULL);
+		bool					_Decode();		// decodes encodedText into plainText
+		bool					_Decode(char *, unsigned long, uint32_t *crc = NULL);
+		int						_DecodeFrame(const THuffmanFrame &, char *);
+		// messages without a header, coded with a preset or a batch's table
+		bool					_EncodeHeaderless(const code_t *, const unsigned char *, unsigned long);
+		bool					_DecodeHeaderless(const TDecodeTable &, const unsigned char *);
+		int						_EncodeFile(const std::string &, const std::string &);
+		int						_DecodeFile(const std::string &, const std::string &);
+		int						_EncodeStream(std::ifstream &, std::ofstream &);
+		int						_DecodeStream(std::ifstream &, std::ofstream &);
+		int						_DecodeBlocks(std::ifstream &, std::ofstream &);
+		int						_EncodePipeline(std::ifstream &, std::ofstream &);
+		int						_DecodePipeline(std::ifstream &, std::ofstream &, bool);
+		int						_EncodeMapped(const TMappedFile &, const std::string &);
+		int						_DecodeMapped(const TMappedFile &, const std::string &);
+		void					_CountLetters(uint32_t *crc = NULL);
+		bool					_Incompressible();
+		bool					_RepeatTable();
+		void					_FindSyncPoints(uint64_t);
+		int						_ReadSeekTable(std::ifstream &, THuffmanSeekTable &);
+		int						_FindBlocks(std::ifstream &, THuffmanSeekTable &, uint64_t, uint64_t, bool);
+		bool					_DecodeSpan(uint64_t, unsigned char, uint64_t, uint64_t, std::string &);
+		void					_EncodeStored();
 		void					_PopulateForest();
-		void					_ReadHeader();
+		bool					_ReadHeader();
 		void					_BuildBitTree();
+		void					_BuildTables();
 		void					_BuildBitTable();
-		void					_WriteHeader(const unsigned long);
-		std::string				_EncodeText();
-		void					_DecodeText();
+		void					_BuildCodeLengths(unsigned char *);
+		void					_ChooseContexts();
+		void					_WriteHeader(const uint64_t);
+		void					_WriteLengths(const unsigned char *);
+		bool					_ReadLengths(unsigned char *);
+		uint64_t				_EncodeBody(TBitBuffer &);
+		void					_AppendBody(const TBitBuffer &);
+		void					_EncodeText(TBitBuffer &, const unsigned char *, unsigned long);
+		void					_EncodeContextText(TBitBuffer &);
+		bool					_DecodeText(const TDecodeTable &);
+		bool					_DecodeText(char *, unsigned long, uint32_t *);
+		void					_DecodeContextText();
+		bool					_DecodeContextText(char *, unsigned long, uint32_t *);
+		bool					_DecodeStreams(char *, unsigned long);
 
 
 		// utility functions
 		void					__CleanUp();
 		void					__DebugForest();
+		static void				__StreamRange(unsigned long, int, unsigned long &, unsigned long &);
+		void					__ShareSettings(std::vector<THuffman> &);
+		// swaps two containers, or moves them round where their memory
+		// resources differ, which a plain swap can't cope with
+		template<class C>
+		static void				__Swap(C & a, C & b) { if(a.get_allocator() == b.get_allocator()) { a.swap(b); return; } C t(std::move(a)); a = std::move(b); b = std::move(t); }
+		bool					__CanChain() const { return reuseTables && !seekTable && !contexts && !interleave; }
+		// statistics, these do nothing unless collectStats is set
+		uint64_t				__StartLap() { return collectStats ? THuffmanStats::Now() : 0; }
+		void					__Lap(int, uint64_t &);
+		void					__StartStats() { if(collectStats) stats.Clear(); }
+		void					__GatherStats(std::vector<THuffman> &);
+		void					__ReportStats() { if(collectStats && statsCallback) statsCallback(stats); }
 
 
 		// a compare function to use with sort()
-		static bool		__TreeFreqCmp(THuffmanBTree *a, THuffmanBTree *b)
-			{ return a->GetRootFreq() < b->GetRootFreq(); }
+		struct __TreeFreqCmp {
+			const THuffmanBTree & tree;
+			__TreeFreqCmp(const THuffmanBTree & t) : tree(t) {}
+			bool operator()(unsigned short a, unsigned short b) const
+				{ return tree.GetFreq(a) < tree.GetFreq(b) || (tree.GetFreq(a) == tree.GetFreq(b) && a < b); }
+		};
+
+		// a block on its way through _EncodePipeline() or _DecodePipeline()
+		struct __PipelineBlock {
+			std::pmr::string text;
+			std::string packed;
+			TBitBuffer bits;
+			std::pmr::vector<uint64_t> sync;
+			THuffmanFrame frame;
+			bool failed;
+			bool bad;		// decoded, but the checksum did not match
+		};
+
+		// times each of the stages above on its own, see bench/
+		friend class THuffmanBench;
 
 	public:
 
-		//THuffman() {}
+		typedef std::function<void(const THuffmanStats &)> statsCallback_t;
+
+		// the containers and scratch buffers of the in-memory calls allocate
+		// from the memory resource given, e.g. a std::pmr::monotonic_buffer_resource
+		// per request that is let go of all at once. only the thread using
+		// the coder touches it. files, preset tables, worker threads and the
+		// strings handed back use the default resource
+		explicit THuffman(std::pmr::memory_resource * = std::pmr::get_default_resource());
 		//~THuffman() {}
 
 		// pass string, returns encoded/decoded result
 		std::string		Encode(const std::string &);
 		std::string		Decode(const std::string &);
+		// pass string and the id of a preset added with AddPreset(). there is
+		// no header, so the same preset must be used to decode. returns ""
+		// if there is no such preset or a letter has no code in it
+		std::string		Encode(const std::string &, unsigned int);
+		std::string		Decode(const std::string &, unsigned int);
 		// filenames, output file will be encoded/decoded from input file
 		int				Encode(const std::string &, const std::string &);
 		int				Decode(const std::string &, const std::string &);
 		// file handles, works as previous
 		int				Encode(std::ifstream &, std::ofstream &);
 		int				Decode(std::ifstream &, std::ofstream &);
+		// appends 'length' bytes of the decoded file from 'offset' to
+		// 'out', decoding as little as it can. with a seek table only the
+		// blocks holding the range are read, and sync points let decoding
+		// start close to 'offset'. returns 0, an error code or 9 if
+		// 'offset' is past the end. 'length' is cut short at the end
+		int				DecodeRange(const std::string &, uint64_t, uint64_t, std::string &);
+
+		// works out a preset from a sample of the messages it will be used
+		// for. letters missing from the sample still get a code
+		void			Train(const std::string &, unsigned int, THuffmanPreset &);
+		void			AddPreset(const THuffmanPreset & a) { presets[a.Id()] = a; }
+		void			RemovePreset(unsigned int id) { presets.erase(id); }
+
+		// encodes 'count' messages one after the other into the 'capacity'
+		// bytes at 'out', and says where each one went. pass 'table' to
+		// code the whole batch with one table, which is written first and
+		// 'table' says where. returns 0, or 7 if 'out' is too small
+		int				EncodeBatch(const THuffmanSlice *, size_t, unsigned char *, size_t, THuffmanExtent *, THuffmanExtent *table = NULL);
+		// the other way, 'table' is the shared table if the batch has one.
+		// returns 0, 6 if a message is not valid or 7 if 'out' is too small
+		int				DecodeBatch(const THuffmanSlice *, size_t, unsigned char *, size_t, THuffmanExtent *, const THuffmanSlice *table = NULL);
+
+		// what this coder was made with
+		std::pmr::memory_resource *GetMemoryResource() { return forest.get_allocator().resource(); }
+
+		// no code will be longer than this, between 8 and 63 bits. 15 by
+		// default, which keeps decoding within two table lookups
+		void			SetMaxCodeLength(unsigned int a) { maxCodeLength = std::max(8u, std::min(a, (unsigned int)HUFFMAN_MAX_CODE_LENGTH)); }
+		unsigned int	GetMaxCodeLength() { return maxCodeLength; }
+		// messages (and blocks of files) that coding would shrink by less
+		// than this fraction are stored as they are, behind a one byte
+		// header. it is judged from the letter counts before any codes are
+		// built, so data that is already compressed costs little more than
+		// a copy. 0.02 by default, 0 only stores what coding would grow
+		void			SetMinSaving(double a) { minSaving = std::max(0.0, std::min(a, 1.0)); }
+		double			GetMinSaving() { return minSaving; }
+
+		// how much of a file is encoded at once, 1 MiB by default and at
+		// most THuffmanFrame::MAX_BLOCK_SIZE (256 MiB)
+		void			SetBlockSize(unsigned long a) { blockSize = std::max(1ul, std::min(a, (unsigned long)THuffmanFrame::MAX_BLOCK_SIZE)); }
+		unsigned long	GetBlockSize() { return blockSize; }
+		// how many blocks of a file are encoded at once, 0 for one per
+		// hardware thread. 1 by default. Encode(string) also uses them to
+		// count the letters of large inputs
+		void			SetThreads(unsigned int a) { threads = a; }
+		unsigned int	GetThreads() { return threads; }
+		// end encoded files with a table of where each block is, for
+		// DecodeRange() and for Decode(istream, ostream) on several threads
+		// without SetPipeline(). off by default
+		void			SetSeekTable(bool a) { seekTable = a; }
+		bool			GetSeekTable() { return seekTable; }
+		// the seek table also says where the code of every this many
+		// letters starts, so DecodeRange() can start decoding close to
+		// where it is asked to rather than at the start of a block. 8
+		// bytes each, 64 KiB by default, 0 for none
+		void			SetSyncInterval(unsigned long a) { syncInterval = (uint32_t)std::min<unsigned long>(a, 0xFFFFFFFF); }
+		unsigned long	GetSyncInterval() { return syncInterval; }
+		// read, code and write files all at once on separate threads (see
+		// pipeline.h), which hides slow disks and networks behind the
+		// coding. SetThreads() is the number of coding threads. takes the
+		// place of memory mapping the files, off by default
+		void			SetPipeline(bool a) { pipeline = a; }
+		bool			GetPipeline() { return pipeline; }
+		// give each block of an encoded file a CRC32C of its letters, which
+		// decoding checks. off by default. files decode the same either way
+		void			SetChecksums(bool a) { checksums = a; }
+		bool			GetChecksums() { return checksums; }
+		// blocks of the last file decoded whose checksum did not match,
+		// counting from 0. decoding returns 8 if there are any
+		const std::vector<uint64_t> &GetBadBlocks() { return badBlocks; }
+		// when encoding a file one block at a time (SetThreads(1)), code a
+		// block with the table of the block before if that comes out
+		// smaller than a table of its own. saves the header and building
+		// the tables, on both sides, for files that look the same all the
+		// way through. such files always decode one block at a time, so
+		// it is ignored with SetSeekTable(), SetContexts() and
+		// SetInterleave(). off by default
+		void			SetReuseTables(bool a) { reuseTables = a; }
+		bool			GetReuseTables() { return reuseTables; }
+		// split the body of each message (or block) into 4 substreams that
+		// are decoded side by side, which decodes faster but costs a few
+		// bytes. off by default, messages too short to gain are never split
+		void			SetInterleave(bool a) { interleave = a; }
+		bool			GetInterleave() { return interleave; }
+		// code each letter with a table picked by the letter before it,
+		// when that comes out smaller than one table for everything.
+		// slower to encode, off by default. takes the place of SetInterleave()
+		void			SetContexts(bool a) { contexts = a; }
+		bool			GetContexts() { return contexts; }
+		// fill in a THuffmanStats on every call, off by default. costs
+		// nothing when off
+		void			SetCollectStats(bool a) { collectStats = a; }
+		bool			GetCollectStats() { return collectStats; }
+		const THuffmanStats &GetStats() { return stats; }
+		// called with the stats at the end of every call, also turns
+		// collecting them on
+		void			SetStatsCallback(const statsCallback_t & a) { statsCallback = a; if(a) collectStats = true; }
 
 };
 
 
+inline THuffman::THuffman(std::pmr::memory_resource *resource)
+	: forest(resource), codeTable(resource), streams(STREAMS, resource), contextDecoders(TContextModel::MAX_TABLES, resource),
+	contextModel(resource), plainText(resource), encodedText(resource), bodyText(resource), syncBits(resource), presets(resource)
+{
+	blockSize = 1 << 20;
+	threads = 1;
+	seekTable = false;
+	pool = NULL;
+	maxCodeLength = 15;
+	collectStats = false;
+	interleave = false;
+	streamed = false;
+	contexts = false;
+	contextMode = false;
+	pipeline = false;
+	checksums = false;
+	stored = false;
+	minSaving = 0.02;
+	haveTable = false;
+	reuseTables = false;
+	chainTables = false;
+	repeated = false;
+	haveSent = false;
+	syncInterval = 1 << 16;
+	syncEvery = 0;
+}
+
+
 inline std::string THuffman::Encode(const std::string & input)
 {
-	puts("Encode");
-	plainText.assign(input);
+	// the threads would sit idle for anything smaller, so aren't started
+	TWorkerPool *workers = NULL;
+	if(threads != 1 && input.size() >= THistogram::PARALLEL_MIN_BYTES) workers = new TWorkerPool(threads);
+	pool = workers;
+	__StartStats();
+	_Encode((const unsigned char *)input.data(), input.size());
+	__ReportStats();
+	pool = NULL;
+	delete workers;
+	return std::string(encodedText.Bytes());
+}
+inline std::string THuffman::Decode(const std::string & input)
+{
+	encodedText.AssignBytes(input);
+	haveTable = false;
+	__StartStats();
+	_Decode();
+	__ReportStats();
+	return std::string(plainText);
+}
+
+
+inline void THuffman::_Encode(const unsigned char *data, unsigned long len, uint32_t *crc)
+{
+	plainData = data;
+	plainSize = len;
 	encodedText.Clear();
-	printf("Plain Size:    %u bytes\n", plainText.size());
 
-	_PopulateForest();			// modifies: forest, freqTable, bitTable
+	uint64_t lap = __StartLap();
+	_CountLetters(crc);			// modifies: freqTable
+	__Lap(THuffmanStats::HISTOGRAM, lap);
+	if(collectStats) {
+		// before _PopulateForest() can add a letter that isn't there
+		stats.AddLetterCounts(freqTable.Counts());
+		lap = __StartLap();
+	}
+	if(_Incompressible()) {
+		_EncodeStored();
+		__Lap(THuffmanStats::BODY_ENCODE, lap);
+		return;
+	}
+	_PopulateForest();			// modifies: forest, freqTable
 	//__DebugForest();
 	_BuildBitTree();			// modifies: forest
 	//__DebugForest();
-	_BuildBitTable();			// modifies: bitTable
-	printf("Characters:    %u\n", bitTable.size());
+	__Lap(THuffmanStats::TREE_BUILD, lap);
+	repeated = chainTables && _RepeatTable();	// modifies: bitTable, codeLengths
+	if(!repeated)
+		_BuildTables();				// modifies: bitTable, context*
+	__Lap(THuffmanStats::TABLE_BUILD, lap);
 
 	// build the body first, so we can get the size and pass it to _GenerateHeader()
-	std::string tmp = _EncodeText();
-	_WriteHeader(tmp.size());
-	printf("Header Size:   %u bits\n", encodedText.Size());
-	printf("Body Size:     %u bits\n", tmp.size());
-	encodedText.AppendBits(tmp);
+	bodyText.Clear();
+	uint64_t bodySize = _EncodeBody(bodyText);
+	__Lap(THuffmanStats::BODY_ENCODE, lap);
+	_WriteHeader(bodySize);
+	__Lap(THuffmanStats::HEADER_WRITE, lap);
+	// the estimate only rules out the hopeless, coding must never come
+	// out bigger than storing
+	if(encodedText.Size() + bodySize >= ((uint64_t)plainSize + 1) * 8) {
+		_EncodeStored();
+		__Lap(THuffmanStats::BODY_ENCODE, lap);
+		return;
+	}
+	// the decoder now has this table, for the next message to repeat
+	if(chainTables && !repeated && !contextMode) {
+		memcpy(sentTable, bitTable, sizeof(sentTable));
+		memcpy(sentLengths, codeLengths, sizeof(sentLengths));
+		haveSent = true;
+	}
+	if(syncEvery) _FindSyncPoints(encodedText.Size());
+	if(collectStats) {
+		stats.messages++;
+		stats.inputBytes += plainSize;
+		stats.headerBits += encodedText.Size();
+		stats.bodyBits += bodySize;
+		if(contextMode) {
+			for(unsigned int t=0;t<contextTables;t++)
+				stats.AddCodeLengths(contextLengths[t]);
+		} else {
+			stats.AddCodeLengths(codeLengths);
+		}
+	}
+	_AppendBody(bodyText);
 
 	__CleanUp();
 
-	printf("Total Size:    %u bytes\n", (encodedText.Size() / 8));
-	return encodedText.ReadAllBytes();
+	encodedText.Flush();
+	plainData = NULL;
+	__Lap(THuffmanStats::BODY_ENCODE, lap);
+	if(collectStats) stats.outputBytes += encodedText.Bytes().size();
 }
-inline std::string THuffman::Decode(const std::string & input)
+inline bool THuffman::_Decode()
 {
-	puts("Decode");
 	plainText.clear();
-	encodedText.AssignBytes(input);
-	printf("Encoded Size:  %u bytes\n", (encodedText.Size() / 8));
+	uint64_t encodedBits = encodedText.Size();
 
-	_ReadHeader();			// modifies: codeTable
-	printf("Characters:    %u\n", codeTable.size());
+	uint64_t lap = __StartLap();
+	if(!_ReadHeader()) {	// modifies: codeLengths, codeTable
+		__CleanUp();
+		return false;
+	}
+	__Lap(THuffmanStats::HEADER_READ, lap);
+	uint64_t bodyBits = encodedText.Size();
 	//__DebugForest();
-	_DecodeText();
-
+	bool r = true;
+	if(stored) {
+		plainText.assign((const char *)encodedText.Data() + encodedText.Position() / 8, encodedText.Size() / 8);
+	} else if(streamed) {
+		plainText.resize(streamLetters);
+		r = _DecodeStreams(&plainText[0], streamLetters);
+		if(!r) plainText.clear();
+	} else if(contextMode) {
+		_DecodeContextText();
+	} else {
+		_DecodeText(codeTable);
+	}
+	__Lap(THuffmanStats::BODY_DECODE, lap);
+
+	if(collectStats) {
+		THistogram counts;
+		counts.Count((const unsigned char *)plainText.data(), plainText.size());
+		stats.messages++;
+		stats.inputBytes += (encodedBits + 7) / 8;
+		stats.outputBytes += plainText.size();
+		stats.headerBits += encodedBits - bodyBits;
+		stats.bodyBits += bodyBits;
+		if(!stored) stats.AddCodeLengths(codeLengths);
+		stats.AddLetterCounts(counts.Counts());
+	}
 	__CleanUp();
+	return r;
+}
+// decodes encodedText into 'out', which must be exactly 'len' letters
+// long. returns false if the message does not fit. with 'crc', also sets
+// it to the Crc32c() of the letters
+inline bool THuffman::_Decode(char *out, unsigned long len, uint32_t *crc)
+{
+	uint64_t encodedBits = encodedText.Size();
+	uint64_t lap = __StartLap();
+	bool r = _ReadHeader();
+	__Lap(THuffmanStats::HEADER_READ, lap);
+	uint64_t bodyBits = encodedText.Size();
+	if(crc) *crc = 0;
+	if(r && stored) {
+		r = bodyBits / 8 == len;
+		if(r) memcpy(out, encodedText.Data() + encodedText.Position() / 8, len);
+		if(r && crc) *crc = Crc32c((const unsigned char *)out, len);
+	} else {
+		r = r && _DecodeText(out, len, crc);
+	}
+	__Lap(THuffmanStats::BODY_DECODE, lap);
+	encodedText.Clear();
 
-	printf("Decoded Size:  %u bytes\n", plainText.size());
-	return plainText;
+	if(collectStats && r) {
+		THistogram counts;
+		counts.Count((const unsigned char *)out, len);
+		stats.messages++;
+		stats.inputBytes += (encodedBits + 7) / 8;
+		stats.outputBytes += len;
+		stats.headerBits += encodedBits - bodyBits;
+		stats.bodyBits += bodyBits;
+		if(!stored) stats.AddCodeLengths(codeLengths);
+		stats.AddLetterCounts(counts.Counts());
+	}
+	__CleanUp();
+	return r;
+}
+// decodes the message of a file's frame into 'out', which must hold its
+// rawSize letters. the checksum, if it has one, is worked out as they are
+// decoded. returns 0, 6 if the message is invalid or 8 if it doesn't
+// match its checksum
+inline int THuffman::_DecodeFrame(const THuffmanFrame & frame, char *out)
+{
+	bool checked = frame.type == THuffmanFrame::HUFFMAN_CHECKED;
+	uint32_t crc;
+	if(!_Decode(out, frame.rawSize, checked ? &crc : NULL)) return 6;
+	return (checked && crc != frame.checksum) ? 8 : 0;
 }
 
 
-inline std::string THuffman::_EncodeText()
+inline std::string THuffman::Encode(const std::string & input, unsigned int presetId)
 {
-	//puts("_EncodeText()");
-	std::string r = "";
-	unsigned int len = plainText.size();
-	// walk through the input string, looking up each character as we go
-	for(unsigned int i=0;i<len;i++)
-		r.append(bitTable[plainText.at(i)]->ReadAllBits());
+	std::pmr::map<unsigned int, THuffmanPreset>::const_iterator preset = presets.find(presetId);
+	if(preset == presets.end()) return "";
+	__StartStats();
+	bool r = _EncodeHeaderless(preset->second.Codes(), (const unsigned char *)input.data(), input.size());
+	__ReportStats();
+	return r ? std::string(encodedText.Bytes()) : "";
+}
+inline std::string THuffman::Decode(const std::string & input, unsigned int presetId)
+{
+	std::pmr::map<unsigned int, THuffmanPreset>::const_iterator preset = presets.find(presetId);
+	if(preset == presets.end()) return "";
+	encodedText.AssignBytes(input);
+	__StartStats();
+	_DecodeHeaderless(preset->second.Table(), preset->second.Lengths());
+	std::string r(plainText);
+	__ReportStats();
 	return r;
 }
-// read the text one bit at a time. everytime we add one bit and look it up.
-// if we can't find it, read another...
-// this works because the bit codes are unique
-// the codeTable.find(buf) is the slowest part of the whole process (encoding or decoding)
-inline void THuffman::_DecodeText()
+/*
+	-- implimentation note --
+	each message is made in encodedText (or plainText) as usual and copied
+	out. those, 'bodyText' and the tables keep their memory between
+	messages, so once they have grown to fit the biggest message nothing
+	else is allocated
+*/
+inline int THuffman::EncodeBatch(const THuffmanSlice *in, size_t count, unsigned char *out, size_t capacity, THuffmanExtent *where, THuffmanExtent *table)
 {
-	//puts("_DecodeText()");
-	unsigned long len = encodedText.Size();
-	std::string buf = "";
-	for(unsigned long i=0;i<len;i++) {
-		buf.append(1, encodedText.ReadBit());
-		// FIXME: slowest line in whole code:
-		if(codeTable.find(buf) != codeTable.end()) {
-			plainText.append(1, codeTable[buf]);
-			buf.clear();
+	__StartStats();
+	size_t used = 0;
+	int r = 0;
+	if(table != NULL) {
+		// one tree for the letters of every message, then just its header
+		freqTable.Clear();
+		for(size_t i=0;i<count;i++)
+			freqTable.Count(in[i].data, in[i].len);
+		_PopulateForest();
+		_BuildBitTree();
+		_BuildBitTable();
+		encodedText.Clear();
+		_WriteHeader(0);
+		encodedText.Flush();
+		const std::pmr::string & bytes = encodedText.Bytes();
+		if(bytes.size() > capacity) r = 7;
+		else memcpy(out, bytes.data(), bytes.size());
+		table->offset = 0;
+		table->len = bytes.size();
+		used = bytes.size();
+		if(collectStats) {
+			stats.headerBits += bytes.size() * 8;
+			stats.outputBytes += bytes.size();
+		}
+	}
+
+	for(size_t i=0;i<count && r==0;i++) {
+		if(table != NULL)
+			_EncodeHeaderless(bitTable, in[i].data, in[i].len);
+		else
+			_Encode(in[i].data, in[i].len);
+		const std::pmr::string & bytes = encodedText.Bytes();
+		if(bytes.size() > capacity - used) {
+			r = 7;
+			break;
 		}
+		memcpy(out + used, bytes.data(), bytes.size());
+		where[i].offset = used;
+		where[i].len = bytes.size();
+		used += bytes.size();
 	}
+	if(table != NULL) __CleanUp();
+	encodedText.Clear();
+	__ReportStats();
+	return r;
 }
+inline int THuffman::DecodeBatch(const THuffmanSlice *in, size_t count, unsigned char *out, size_t capacity, THuffmanExtent *where, const THuffmanSlice *table)
+{
+	__StartStats();
+	haveTable = false;
+	int r = 0;
+	if(table != NULL) {
+		// a message with no body, whose header is the table
+		encodedText.AttachBytes(table->data, table->len);
+		if(table->len == 0 || table->data[0] != HEADER_VERSION || !_ReadHeader()) r = 6;
+	}
 
+	size_t used = 0;
+	for(size_t i=0;i<count && r==0;i++) {
+		encodedText.AttachBytes(in[i].data, in[i].len);
+		if(table != NULL ? !_DecodeHeaderless(codeTable, codeLengths) : !_Decode())
+			r = 6;
+		if(r == 0 && plainText.size() > capacity - used) r = 7;
+		if(r != 0) break;
+		memcpy(out + used, plainText.data(), plainText.size());
+		where[i].offset = used;
+		where[i].len = plainText.size();
+		used += plainText.size();
+	}
+	if(table != NULL) __CleanUp();
+	encodedText.Clear();
+	__ReportStats();
+	return r;
+}
 
-// using the given string, enter root nodes into the forest for each unique character
-// where duplicates exist, increment totalFrequency
-inline void THuffman::_PopulateForest()
+
+// the same counting and tree building as _Encode(), then the code lengths
+// are kept instead of being written to a header
+inline void THuffman::Train(const std::string & sample, unsigned int id, THuffmanPreset & preset)
 {
-	//puts("_PopulateForest()");
+	plainData = (const unsigned char *)sample.data();
+	plainSize = sample.size();
 
+	_CountLetters();
 	/*
 	-- implimentation note --
-	for speed we populate 'freqTable' first as the map is small and uses
-	simple data types, so it will be faster to look up existing
-	characters compared to filling 'forest' and doing lookups on that
-	which would require searching all the btrees (*very* costly)
+	a preset has to cope with any message, not just the sample. rather
+	than an escape code followed by the letter, every letter is counted
+	once more than it was seen. letters that never turned up end up with
+	the longest codes, which are no longer than an escape code and its
+	letter would have been
 	*/
-	unsigned long len = plainText.size();
+	for(int i=0;i<256;i++)
+		freqTable.Add(i, 1);
+	_PopulateForest();
+	_BuildBitTree();
+	_BuildBitTable();
+	preset.Assign(id, codeLengths);
+
+	__CleanUp();
+	plainData = NULL;
+}
+
+
+/*
+	-- preset message format --
+	[byte_padding]<body>
+	the same as a normal message without the header, the padding marks
+	where the body starts. messages sharing a batch's table are the same
+*/
+inline bool THuffman::_EncodeHeaderless(const code_t *table, const unsigned char *data, unsigned long len)
+{
+	encodedText.Clear();
+	uint64_t lap = __StartLap();
+
+	// the padding goes first, so we need the size of the body up front
+	uint64_t bodySize = 0;
 	for(unsigned long i=0;i<len;i++) {
-		char character = plainText.at(i);
-		if(freqTable.find(character) == freqTable.end()) {
-			freqTable.insert(std::make_pair(character, 1));
-		} else {
-			freqTable[character] += 1;
+		unsigned int codeLen = table[data[i]].len;
+		if(codeLen == 0) return false;
+		bodySize += codeLen;
+	}
+	encodedText.Reserve((bodySize + 8) / 8);
+	encodedText.AppendPadding(bodySize);
+	uint64_t paddingSize = encodedText.Size();
+	encodedText.AppendCodes(data, len, table);
+	encodedText.Flush();
+	__Lap(THuffmanStats::BODY_ENCODE, lap);
+
+	if(collectStats) {
+		THistogram counts;
+		counts.Count(data, len);
+		unsigned char lengths[256];
+		for(int i=0;i<256;i++)
+			lengths[i] = (unsigned char)table[i].len;
+		stats.messages++;
+		stats.inputBytes += len;
+		stats.outputBytes += encodedText.Bytes().size();
+		stats.headerBits += paddingSize;
+		stats.bodyBits += bodySize;
+		stats.AddCodeLengths(lengths);
+		stats.AddLetterCounts(counts.Counts());
+	}
+	return true;
+}
+inline bool THuffman::_DecodeHeaderless(const TDecodeTable & table, const unsigned char *lengths)
+{
+	plainText.clear();
+	uint64_t encodedBits = encodedText.Size();
+	// the end of the padding is always in the first byte
+	if(encodedBits < 8 || encodedText.PeekBits(8) == 0) {
+		encodedText.Clear();
+		return false;
+	}
+
+	uint64_t lap = __StartLap();
+	encodedText.ReadPadding();
+	uint64_t bodyBits = encodedText.Size();
+	bool r = _DecodeText(table);
+	__Lap(THuffmanStats::BODY_DECODE, lap);
+	encodedText.Clear();
+
+	if(collectStats) {
+		THistogram counts;
+		counts.Count((const unsigned char *)plainText.data(), plainText.size());
+		stats.messages++;
+		stats.inputBytes += (encodedBits + 7) / 8;
+		stats.outputBytes += plainText.size();
+		stats.headerBits += encodedBits - bodyBits;
+		stats.bodyBits += bodyBits;
+		stats.AddCodeLengths(lengths);
+		stats.AddLetterCounts(counts.Counts());
+	}
+	return r;
+}
+
+
+// encodes plainData into 'body', or into the substreams if it is worth
+// splitting. returns the size of the body in bits
+inline uint64_t THuffman::_EncodeBody(TBitBuffer & body)
+{
+	if(contextMode) {
+		streamed = false;
+		_EncodeContextText(body);
+		return body.Size();
+	}
+	streamed = interleave && plainSize >= STREAMS_MIN_LETTERS;
+	if(!streamed) {
+		_EncodeText(body, plainData, plainSize);
+		return body.Size();
+	}
+
+	// each substream is byte aligned, so they can be found from their sizes
+	uint64_t r = 0;
+	streamLetters = plainSize;
+	for(int s=0;s<STREAMS;s++) {
+		unsigned long start, count;
+		__StreamRange(plainSize, s, start, count);
+		streams[s].Clear();
+		_EncodeText(streams[s], plainData + start, count);
+		streams[s].Flush();
+		streamBytes[s] = streams[s].Bytes().size();
+		r += streamBytes[s] * 8;
+	}
+	return r;
+}
+// after the header, add what _EncodeBody() made
+inline void THuffman::_AppendBody(const TBitBuffer & body)
+{
+	if(!streamed) {
+		encodedText.AppendBuffer(body);
+		return;
+	}
+	for(int s=0;s<STREAMS;s++)
+		encodedText.AppendBuffer(streams[s]);
+}
+inline void THuffman::_EncodeText(TBitBuffer & r, const unsigned char *data, unsigned long len)
+{
+	//puts("_EncodeText()");
+	r.AppendCodes(data, len, bitTable);
+}
+// as _EncodeText(), the table is picked by the letter before
+inline void THuffman::_EncodeContextText(TBitBuffer & r)
+{
+	r.Reserve(plainSize);
+	unsigned char previous = 0;
+	for(unsigned long i=0;i<plainSize;i++) {
+		unsigned int table = contextMap[previous];
+		unsigned char letter = plainData[i];
+		r.AppendBits(contextCodes[table][letter], contextLengths[table][letter]);
+		previous = letter;
+	}
+}
+// look up the next few bits in codeTable, which tells us the letter and
+// how many of those bits its code actually used.
+// this works because the bit codes are unique
+// false if the body is corrupt or cut short, 'plainText' then holds the
+// letters before that
+inline bool THuffman::_DecodeText(const TDecodeTable & table)
+{
+	//puts("_DecodeText()");
+	// the body is at least one bit per letter
+	plainText.reserve(encodedText.Size());
+	unsigned char letter;
+	for(uint64_t left=encodedText.Size();left>0;) {
+		if(!table.Decode(encodedText, letter)) return false;	// corrupt input
+		// a code running off the end means the message was cut short
+		if(encodedText.Size() > left) return false;
+		left = encodedText.Size();
+		plainText.append(1, (char)letter);
+	}
+	return true;
+}
+// as above, when we already know how many letters there are. with 'crc',
+// the letters are decoded a piece at a time and each piece is added to it
+// while it is still in the cache
+inline bool THuffman::_DecodeText(char *out, unsigned long len, uint32_t *crc)
+{
+	if(streamed) {
+		// the substreams fill four parts of the block at once, so it is
+		// only checked once they are done
+		if(streamLetters != len || !_DecodeStreams(out, len)) return false;
+		if(crc) *crc = Crc32c((const unsigned char *)out, len, *crc);
+		return true;
+	}
+	if(contextMode)
+		return _DecodeContextText(out, len, crc);
+
+	unsigned long piece = crc ? (unsigned long)THistogram::CRC_PIECE : len;
+	unsigned char letter;
+	for(unsigned long start=0;start<len;start+=piece) {
+		unsigned long end = std::min(len, start + piece);
+		for(unsigned long i=start;i<end;i++) {
+			if(!codeTable.Decode(encodedText, letter)) return false;
+			out[i] = (char)letter;
+		}
+		if(crc) *crc = Crc32c((const unsigned char *)out + start, end - start, *crc);
+	}
+	// all that should be left is the padding in the last byte
+	return encodedText.Size() < 8;
+}
+// as _DecodeText(), the table is picked by the letter before
+inline void THuffman::_DecodeContextText()
+{
+	const TDecodeTable *tables[256];
+	for(int i=0;i<256;i++)
+		tables[i] = &contextDecoders[contextMap[i]];
+
+	plainText.reserve(encodedText.Size());
+	unsigned char letter = 0;
+	for(uint64_t left=encodedText.Size();left>0;) {
+		if(!tables[letter]->Decode(encodedText, letter)) break;	// corrupt input
+		if(encodedText.Size() > left) break;
+		left = encodedText.Size();
+		plainText.append(1, (char)letter);
+	}
+}
+inline bool THuffman::_DecodeContextText(char *out, unsigned long len, uint32_t *crc)
+{
+	const TDecodeTable *tables[256];
+	for(int i=0;i<256;i++)
+		tables[i] = &contextDecoders[contextMap[i]];
+
+	unsigned long piece = crc ? (unsigned long)THistogram::CRC_PIECE : len;
+	unsigned char letter = 0;
+	for(unsigned long start=0;start<len;start+=piece) {
+		unsigned long end = std::min(len, start + piece);
+		for(unsigned long i=start;i<end;i++) {
+			if(!tables[letter]->Decode(encodedText, letter)) return false;
+			out[i] = (char)letter;
+		}
+		if(crc) *crc = Crc32c((const unsigned char *)out + start, end - start, *crc);
+	}
+	return encodedText.Size() < 8;
+}
+/*
+	-- implimentation note --
+	each substream has its own reader, so decoding a letter from one does
+	not have to wait for the letter before it in another to say where its
+	code ends. the cpu can work on all four at once
+*/
+inline bool THuffman::_DecodeStreams(char *out, unsigned long len)
+{
+	// the padding before the body ends on a byte boundary
+	const unsigned char *p = encodedText.Data() + encodedText.Position() / 8;
+	unsigned char *dst[STREAMS];
+	unsigned long count[STREAMS];
+	for(int s=0;s<STREAMS;s++) {
+		unsigned long start;
+		__StreamRange(len, s, start, count[s]);
+		dst[s] = (unsigned char *)out + start;
+		streams[s].AttachBytes(p, streamBytes[s]);
+		p += streamBytes[s];
+	}
+
+	// the last substream is the shortest, up to its length all four take
+	// turns, then the others finish off their last letter
+	unsigned long common = count[STREAMS-1];
+	bool ok = true;
+	for(unsigned long i=0;i<common && ok;i++) {
+		bool a = codeTable.Decode(streams[0], dst[0][i]);
+		bool b = codeTable.Decode(streams[1], dst[1][i]);
+		bool c = codeTable.Decode(streams[2], dst[2][i]);
+		bool d = codeTable.Decode(streams[3], dst[3][i]);
+		ok = a & b & c & d;
+	}
+	for(int s=0;s<STREAMS-1;s++)
+		for(unsigned long i=common;i<count[s] && ok;i++)
+			ok = codeTable.Decode(streams[s], dst[s][i]);
+
+	// each substream should be used up, apart from its last byte's padding
+	for(int s=0;s<STREAMS;s++) {
+		ok = ok && streams[s].Size() < 8;
+		streams[s].Clear();
+	}
+	encodedText.SkipBits(encodedText.Size());
+	return ok;
+}
+// the letters that go in substream 's' of a 'len' letter message. all
+// but the last get a quarter rounded up, the last gets what is left
+inline void THuffman::__StreamRange(unsigned long len, int s, unsigned long & start, unsigned long & count)
+{
+	unsigned long quarter = (len + STREAMS - 1) / STREAMS;
+	start = std::min(quarter * s, len);
+	count = std::min(quarter, len - start);
+}
+
+
+/*
+	-- implimentation note --
+	for speed we populate 'freqTable' first as it is a flat array of
+	counters, so it will be faster to count existing characters compared
+	to filling 'forest' and doing lookups on that which would require
+	searching all the btrees (*very* costly)
+*/
+inline void THuffman::_CountLetters(uint32_t *crc)
+{
+	//puts("_CountLetters()");
+	if(crc != NULL) {
+		// the checksum is taken as the letters are counted, rather than
+		// reading the block again
+		*crc = 0;
+		freqTable.Count(plainData, plainSize, crc);
+	} else if(pool != NULL)
+		freqTable.Count(plainData, plainSize, *pool, forest.get_allocator().resource());
+	else
+		freqTable.Count(plainData, plainSize);
+}
+// true if the last table sent codes this message in no more bits than a
+// new table of its own would, header included. if so, that table is put
+// back in bitTable and codeLengths
+inline bool THuffman::_RepeatTable()
+{
+	if(!haveSent) return false;
+	_BuildCodeLengths(codeLengths);
+	uint64_t repeat = 0, fresh = TContextModel::TableBits(freqTable);
+	for(int i=0;i<256;i++) {
+		if(freqTable[i] == 0) continue;
+		if(sentLengths[i] == 0) return false;
+		repeat += freqTable[i] * sentLengths[i];
+		fresh += freqTable[i] * codeLengths[i];
+	}
+	if(repeat > fresh) return false;
+	memcpy(bitTable, sentTable, sizeof(bitTable));
+	memcpy(codeLengths, sentLengths, sizeof(codeLengths));
+	return true;
+}
+// where the code of every syncEvery-th letter starts, counting from the
+// start of the message, with the letter before it in the top byte.
+// 'bodyStart' is the size of the header
+inline void THuffman::_FindSyncPoints(uint64_t bodyStart)
+{
+	syncBits.clear();
+	uint64_t bits = bodyStart;
+	unsigned char previous = 0;
+	unsigned long next = syncEvery;
+	for(unsigned long i=0;i<plainSize;i++) {
+		if(i == next) {
+			// the substreams are not in letter order
+			syncBits.push_back(streamed ? THuffmanSeekTable::NO_SYNC : bits | ((uint64_t)previous << 56));
+			next += syncEvery;
 		}
+		unsigned char letter = plainData[i];
+		bits += contextMode ? contextLengths[contextMap[previous]][letter] : bitTable[letter].len;
+		previous = letter;
+	}
+}
+/*
+	-- implimentation note --
+	no code of one table can beat the entropy of the letter counts, and
+	the table itself costs about what TContextModel::TableBits() says. if
+	even that does not save 'minSaving', nothing is built. tables for each
+	context can beat it though, so with SetContexts() the message is
+	always coded and only stored if it came out bigger
+*/
+inline bool THuffman::_Incompressible()
+{
+	if(contexts) return false;
+	double bits = 8 + TContextModel::TableBits(freqTable) + freqTable.EntropyBits();
+	return bits > (double)plainSize * 8 * (1 - minSaving);
+}
+// the version byte then the letters as they are. takes the place of
+// everything after counting in _Encode()
+inline void THuffman::_EncodeStored()
+{
+	encodedText.Clear();
+	encodedText.AppendByte(HEADER_VERSION_STORED);
+	encodedText.AppendBytes(plainData, plainSize);
+	if(syncEvery) {
+		syncBits.clear();
+		for(uint64_t at=syncEvery;at<plainSize;at+=syncEvery)
+			syncBits.push_back(8 + at * 8);
 	}
+	__CleanUp();
+	plainData = NULL;
+	if(collectStats) {
+		stats.messages++;
+		stats.inputBytes += plainSize;
+		stats.headerBits += 8;
+		stats.bodyBits += (uint64_t)plainSize * 8;
+		stats.outputBytes += encodedText.Bytes().size();
+	}
+}
+// using the letter counts, enter root nodes into the forest for each unique character
+inline void THuffman::_PopulateForest()
+{
+	//puts("_PopulateForest()");
 
 	/*
 	-- stupidity note --
@@ -195,47 +1111,81 @@ inline void THuffman::_PopulateForest()
 	it is unimportant what character we add,
 	as long as its not the one that is actually there
 	*/
-	if(freqTable.size() == 1) {
-		if(freqTable.begin()->first != 'a')
-			freqTable['a'] = 1;
+	if(freqTable.Symbols() == 1) {
+		if(freqTable['a'] == 0)
+			freqTable.Add('a', 1);
 		else
-			freqTable['b'] = 1;
+			freqTable.Add('b', 1);
 	}
 
 	// using 'freqTable' we can now quickly populate the forest
-	std::map<const char, unsigned long>::iterator itr;
-	for(itr = freqTable.begin(); itr != freqTable.end(); itr++) {
-		THuffmanBTree *ht = new THuffmanBTree;		// new root node
-		ht->Insert(itr->first, itr->second);
-		forest.push_back(ht);
+	tree.Clear();
+	forest.reserve(256);
+	for(int i=0;i<256;i++) {
+		if(freqTable[i] == 0) continue;
+		forest.push_back(tree.AddLeaf(i, freqTable[i]));		// new root node
 	}
 
 	// sort the forest by totalFrequency, highest value at the end
-	sort(forest.begin(), forest.end(), __TreeFreqCmp);
+	sort(forest.begin(), forest.end(), __TreeFreqCmp(tree));
 }
 
 
-inline void THuffman::_WriteHeader(unsigned long bodySize)
+inline void THuffman::_WriteHeader(uint64_t bodySize)
 {
 	//puts("_WriteHeader()");
 
 	/*
 	-- header format --
-	[total_letters]<letters>[byte_padding]
-	<letters>:
-		[letter][code_len][code]
+	[version]<lengths>[substreams][byte_padding]
+	<lengths>:
+		the canonical code length of letters 0 to 255, as 6 bit tokens
+		[0][run-1, 8 bits]	a run of letters that are not used
+		[1-63]				the code length of the next letter
+	the codes themselves are not stored, both sides regenerate them
+	from the lengths
+	[substreams]: version 3 only
+		[width-1, 6 bits][letters][size of substreams 1 to 3 in bytes]
+		each number 'width' bits. the body is the substreams one after
+		the other, each padded to a whole byte
+	version 4 has a table for each group of contexts in place of <lengths>:
+		[tables-1, 4 bits][table of contexts 0 to 255]<lengths>...
+		each context's table number takes as few bits as hold tables-1,
+		then come the lengths of each table
+	version 5 is just [version] with the letters as they are after it,
+	see _EncodeStored()
+	version 6 is [version][byte_padding], the body is coded with the
+	last table sent (see _RepeatTable())
 	*/
 
 	// we'll write directly to encodedText
 	encodedText.Clear();
-	encodedText.AppendByte(bitTable.size());		// how many letters
+	if(contextMode) {
+		encodedText.AppendByte(HEADER_VERSION_CONTEXTS);
+		encodedText.AppendBits(contextTables - 1, 4);
+		unsigned int width = 0;
+		while((1u << width) < contextTables) width++;
+		for(int i=0;i<256;i++)
+			encodedText.AppendBits(contextMap[i], width);
+		for(unsigned int t=0;t<contextTables;t++)
+			_WriteLengths(contextLengths[t]);
+	} else if(repeated) {
+		encodedText.AppendByte(HEADER_VERSION_REPEAT);
+	} else {
+		encodedText.AppendByte(streamed ? HEADER_VERSION_STREAMS : HEADER_VERSION);
+		_WriteLengths(codeLengths);
+	}
 
-	// add each letter
-	std::map<const char, TBitBuffer*>::iterator itr;
-	for(itr = bitTable.begin(); itr != bitTable.end(); itr++) {
-		encodedText.AppendByte(itr->first);
-		encodedText.AppendNumber(itr->second->Size());
-		encodedText.AppendBits(itr->second->ReadAllBits());
+	if(streamed) {
+		uint64_t largest = streamLetters;
+		for(int s=0;s<STREAMS-1;s++)
+			largest = std::max(largest, streamBytes[s]);
+		unsigned int width = 1;
+		while(width < 64 && (largest >> width) != 0) width++;
+		encodedText.AppendBits(width - 1, 6);
+		encodedText.AppendBits(streamLetters, width);
+		for(int s=0;s<STREAMS-1;s++)
+			encodedText.AppendBits(streamBytes[s], width);
 	}
 
 	/*
@@ -252,189 +1202,991 @@ inline void THuffman::_WriteHeader(unsigned long bodySize)
 	*/
 	encodedText.AppendPadding(encodedText.Size() + bodySize);
 }
-// nothing special to say here. does the opposite of _WriteHeader()
-inline void THuffman::_ReadHeader()
+inline void THuffman::_WriteLengths(const unsigned char *lengths)
+{
+	for(int i=0;i<256;) {
+		if(lengths[i] > 0) {
+			encodedText.AppendBits(lengths[i++], 6);
+			continue;
+		}
+		int run = 0;
+		while(i < 256 && lengths[i] == 0) {
+			run++;
+			i++;
+		}
+		encodedText.AppendBits(0, 6);
+		encodedText.AppendBits(run - 1, 8);
+	}
+}
+// does the opposite of _WriteHeader(), returns false if the header is
+// not one we understand
+inline bool THuffman::_ReadHeader()
 {
 	//puts("_ReadHeader()");
-	unsigned char characters = encodedText.ReadByte();
-	//printf("Header says there are %u characters:\n", characters);
-	char character;
-	unsigned long len;
-	std::string charCode;
-	for(unsigned char i=0;i<characters;i++) {
-		character = encodedText.ReadByte();
-		len = encodedText.ReadNumber();
-		charCode = encodedText.ReadBits(len);
-		codeTable.insert(std::make_pair(charCode, character));
-		// this output is the same as encoding's _BuildBitTable()
-		//printf("%c = %s\n", character, charCode.c_str());
+	uint64_t encodedBits = encodedText.Size();
+	unsigned char version = (unsigned char)encodedText.ReadByte();
+	if(version < HEADER_VERSION || version > HEADER_VERSION_REPEAT) return false;
+	// the letters follow straight on, with no padding
+	stored = version == HEADER_VERSION_STORED;
+	if(stored) return encodedText.Size() < encodedBits;
+	if(version == HEADER_VERSION_REPEAT) {
+		// the table of the message before is still in codeTable
+		if(!haveTable) return false;
+		encodedText.ReadPadding();
+		return encodedText.Size() <= encodedBits;
+	}
+	streamed = version == HEADER_VERSION_STREAMS;
+	contextMode = version == HEADER_VERSION_CONTEXTS;
+
+	if(contextMode) {
+		contextTables = (unsigned int)encodedText.ReadBits(4) + 1;
+		unsigned int width = 0;
+		while((1u << width) < contextTables) width++;
+		for(int i=0;i<256;i++) {
+			contextMap[i] = (unsigned char)encodedText.ReadBits(width);
+			if(contextMap[i] >= contextTables) return false;
+		}
+		for(unsigned int t=0;t<contextTables;t++) {
+			if(!_ReadLengths(contextLengths[t])) return false;
+			contextDecoders[t].Build(contextLengths[t]);
+		}
+	} else if(!_ReadLengths(codeLengths)) {
+		return false;
+	}
+
+	if(streamed) {
+		unsigned int width = (unsigned int)encodedText.ReadBits(6) + 1;
+		streamLetters = encodedText.ReadBits(width);
+		for(int s=0;s<STREAMS-1;s++)
+			streamBytes[s] = encodedText.ReadBits(width);
+	}
+	if(!contextMode) {
+		codeTable.Build(codeLengths);
+		haveTable = true;
 	}
 	encodedText.ReadPadding();
+	// a cut short message has the header run off the end
+	if(encodedText.Size() > encodedBits) return false;
+
+	if(streamed) {
+		// the substreams must fit in what is left, and every letter
+		// takes at least a bit
+		uint64_t left = encodedText.Size() / 8;
+		for(int s=0;s<STREAMS-1;s++) {
+			if(streamBytes[s] > left) return false;
+			left -= streamBytes[s];
+		}
+		streamBytes[STREAMS-1] = left;
+		if(streamLetters > encodedText.Size()) return false;
+	}
+	return true;
+}
+inline bool THuffman::_ReadLengths(unsigned char *lengths)
+{
+	for(int i=0;i<256;) {
+		unsigned char len = (unsigned char)encodedText.ReadBits(6);
+		if(len > 0) {
+			lengths[i++] = len;
+			continue;
+		}
+		int run = (int)encodedText.ReadBits(8) + 1;
+		if(i + run > 256) return false;
+		for(;run>0;run--)
+			lengths[i++] = 0;
+	}
+	return true;
 }
 
 
 // using our 'forest', build a greedy tree of the character's frequency
-// although this function has both erase() and sort(), under testing it isn't all that slow
+/*
+	-- implimentation note --
+	the forest starts out sorted, and every tree we make by joining the two
+	lightest trees is at least as heavy as the one made before it. so the
+	lightest trees are always at the front of one of two queues: the
+	leaves left in the forest, or the trees made so far. no sorting needed.
+	the trees made so far are simply the nodes after the leaves in 'tree'.
+	when both fronts weigh the same we take the leaf, which keeps the
+	longest code as short as possible
+*/
 inline void THuffman::_BuildBitTree()
 {
 	//puts("_BuildBitTree()");
-	while(forest.size() > 1) {
+	size_t leaves = forest.size();
+	if(leaves < 2) return;
+
+	size_t nextLeaf = 0;
+	unsigned short nextMerged = tree.Size();
+	while((leaves - nextLeaf) + (tree.Size() - nextMerged) > 1) {
 		// take the 2 lowest frequency items and combine into a new forest node
-		THuffmanBTree * lowestFreqNode1 = forest.at(0);
-		THuffmanBTree * lowestFreqNode2 = forest.at(1);
-		// we can remove them from the forest now
-		forest.erase(forest.begin());
-		forest.erase(forest.begin());
-		//printf("1) %c : %u\n", lowestFreqNode1->GetRootLetter(), lowestFreqNode1->GetRootFreq());
-		//printf("2) %c : %u\n", lowestFreqNode2->GetRootLetter(), lowestFreqNode2->GetRootFreq());
-		// create a new place in the forest to keep them
-		THuffmanBTree *foo = new THuffmanBTree;
-		foo->DefineRoot(NULL, lowestFreqNode1->GetRoot(), lowestFreqNode2->GetRoot());
-		forest.insert(forest.begin(), foo);
-		// the order has changed, re-sort
-		// FIXME: this is very inefficient, there are better ways
-		sort(forest.begin(), forest.end(), __TreeFreqCmp);
-	}
-}
-
-
-// using freqTable that was built by PopulateForest(),
-// walk through the character list and store the bit code associated with each
+		unsigned short lowestFreqNode[2];
+		for(int i=0;i<2;i++) {
+			if(nextMerged == tree.Size() ||
+				(nextLeaf < leaves && tree.GetFreq(forest[nextLeaf]) <= tree.GetFreq(nextMerged)))
+				lowestFreqNode[i] = forest[nextLeaf++];
+			else
+				lowestFreqNode[i] = nextMerged++;
+		}
+		tree.AddNode(lowestFreqNode[0], lowestFreqNode[1]);
+	}
+	forest.assign(1, tree.GetRoot());
+}
+
+
+// the tree only decides how long each code is. the codes themselves are
+// the canonical ones for those lengths, so the header can skip them
 inline void THuffman::_BuildBitTable()
 {
 	//puts("_BuildBitTable()");
-	std::map<const char, unsigned long>::iterator itr;
-	for(itr = freqTable.begin(); itr != freqTable.end(); itr++) {
-		char character = itr->first;
-		TBitBuffer *bb = new TBitBuffer;
-		bb->AssignBits(forest.at(0)->BitCode(character));
-		bitTable.insert(std::make_pair(character, bb));
-		//printf("%c = %s\n", character, bb->ReadAllBits().c_str());
+	_BuildCodeLengths(codeLengths);
+
+	uint64_t canonical[256];
+	CanonicalCodes(codeLengths, canonical);
+
+	for(int i=0;i<256;i++) {
+		bitTable[i].bits = canonical[i];
+		bitTable[i].len = codeLengths[i];
+		//printf("%c = %u/%u\n", i, (unsigned int)bitTable[i].bits, bitTable[i].len);
+	}
+}
+// the one table, and the context tables if they are wanted
+inline void THuffman::_BuildTables()
+{
+	_BuildBitTable();
+	if(contexts && plainSize >= CONTEXTS_MIN_LETTERS)
+		_ChooseContexts();
+}
+// the length of each letter's code in the tree, no longer than maxCodeLength
+inline void THuffman::_BuildCodeLengths(unsigned char *lengths)
+{
+	for(int i=0;i<256;i++)
+		lengths[i] = 0;
+	tree.CodeLengths(lengths);
+	LimitCodeLengths(lengths, freqTable.Counts(), maxCodeLength);
+}
+// build a table for each group of contexts, and use them if the message
+// comes out smaller than with the one table already built
+inline void THuffman::_ChooseContexts()
+{
+	// the one table, header and body
+	uint64_t oneTable = TContextModel::TableBits(freqTable);
+	for(int i=0;i<256;i++)
+		oneTable += freqTable[i] * codeLengths[i];
+
+	contextModel.Clear();
+	contextModel.Count(plainData, plainSize);
+	contextModel.Cluster();
+	contextTables = contextModel.Tables();
+	for(int i=0;i<256;i++)
+		contextMap[i] = contextModel.Map()[i];
+
+	unsigned int width = 0;
+	while((1u << width) < contextTables) width++;
+	uint64_t manyTables = 4 + 256 * width;
+	for(unsigned int t=0;t<contextTables;t++) {
+		// the same tree building as for the one table, on this group's counts
+		const THistogram & counts = contextModel.Counts(t);
+		freqTable = counts;
+		tree.Clear();
+		forest.clear();
+		_PopulateForest();
+		_BuildBitTree();
+		_BuildCodeLengths(contextLengths[t]);
+		CanonicalCodes(contextLengths[t], contextCodes[t]);
+
+		manyTables += TContextModel::TableBits(freqTable);
+		for(int i=0;i<256;i++)
+			manyTables += counts[i] * contextLengths[t][i];
 	}
+	contextMode = manyTables < oneTable;
 }
 
 
 inline int THuffman::Encode(const std::string & inputFile, const std::string & outputFile)
 {
+	__StartStats();
+	int r = _EncodeFile(inputFile, outputFile);
+	chainTables = false;
+	syncEvery = 0;
+	__ReportStats();
+	return r;
+}
+inline int THuffman::Encode(std::ifstream & fInput, std::ofstream & fOutput)
+{
+	__StartStats();
+	int r = _EncodeStream(fInput, fOutput);
+	chainTables = false;
+	syncEvery = 0;
+	__ReportStats();
+	return r;
+}
+inline int THuffman::Decode(const std::string & inputFile, const std::string & outputFile)
+{
+	__StartStats();
+	int r = _DecodeFile(inputFile, outputFile);
+	__ReportStats();
+	return r;
+}
+inline int THuffman::Decode(std::ifstream & fInput, std::ofstream & fOutput)
+{
+	__StartStats();
+	int r = _DecodeStream(fInput, fOutput);
+	__ReportStats();
+	return r;
+}
+
+
+inline int THuffman::_EncodeFile(const std::string & inputFile, const std::string & outputFile)
+{
+	// pipes and other files that can't be mapped are read as a stream
+	TMappedFile input;
+	if(!pipeline && input.OpenRead(inputFile))
+		return _EncodeMapped(input, outputFile);
+
 	std::ifstream fInput;
 	std::ofstream fOutput;
 
-	fInput.open(inputFile.c_str(), std::ios::in);
+	fInput.open(inputFile.c_str(), std::ios::in | std::ios::binary);
 	if(!fInput.is_open()) return 1;
 	fOutput.open(outputFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
 
-	int r = Encode(fInput, fOutput);
+	int r = _EncodeStream(fInput, fOutput);
 
 	fInput.close();
 	fOutput.close();
 
 	return r;
 }
-inline int THuffman::Encode(std::ifstream & fInput, std::ofstream & fOutput)
+// read the input a batch of blocks at a time, one block per worker.
+// the blocks are encoded at the same time, then written out in order as
+// frames before moving on to the next batch
+inline int THuffman::_EncodeStream(std::ifstream & fInput, std::ofstream & fOutput)
 {
 	if(!fInput.is_open()) return 1;
 	if(!fOutput.is_open()) return 2;
-
-	std::string line, text = "";
-
-	// get file size
-	fInput.seekg(0, std::ios::end);
-	std::fstream::pos_type totalBytes = fInput.tellg();
-	fInput.seekg(0, std::ios::beg);
-
-	if(!totalBytes) return 3;
-
-	while(!fInput.eof()) {
-		getline(fInput, line);
-		if(fInput.bad()) return 4;
-		text.append(line + "\n");
+	if(pipeline) return _EncodePipeline(fInput, fOutput);
+
+	// worker 0 is us, the others get their own THuffman as all the
+	// encoding state lives in member fields
+	TWorkerPool workers(threads);
+	std::vector<THuffman> coders(workers.Size() - 1);
+	syncEvery = seekTable ? syncInterval : 0;
+	__ShareSettings(coders);
+	chainTables = workers.Size() == 1 && __CanChain();
+	haveSent = false;
+
+	std::string out;
+	THuffmanStreamHeader header;
+	if(seekTable) header.flags |= THuffmanStreamHeader::SEEK_TABLE;
+	if(chainTables) header.flags |= THuffmanStreamHeader::SHARED_TABLES;
+	header.Write(out);
+	std::vector<std::string> blocks(workers.Size());
+	std::vector<TBitBuffer> payloads(workers.Size());
+	std::vector<uint32_t> crcs(workers.Size());
+	std::vector<std::pmr::vector<uint64_t> > syncs(workers.Size());
+
+	unsigned long long totalBytes = 0, written = 0;
+	THuffmanSeekTable table;
+	table.syncInterval = syncEvery;
+	THuffmanFrame frame;
+	frame.type = checksums ? THuffmanFrame::HUFFMAN_CHECKED : THuffmanFrame::HUFFMAN;
+	while(fInput) {
+		size_t count = 0;
+		for(;count<blocks.size() && fInput;count++) {
+			blocks[count].resize(blockSize);
+			fInput.read(&blocks[count][0], blockSize);
+			if(fInput.bad()) return 4;
+			std::streamsize len = fInput.gcount();
+			if(len <= 0) break;
+			blocks[count].resize(len);
+		}
+		if(count == 0) break;
+
+		workers.Run(count, [&](size_t i, unsigned int worker) {
+			THuffman & coder = (worker == 0) ? *this : coders[worker - 1];
+			coder._Encode((const unsigned char *)blocks[i].data(), blocks[i].size(), checksums ? &crcs[i] : NULL);
+			coder.encodedText.Swap(payloads[i]);
+			__Swap(coder.syncBits, syncs[i]);
+		});
+
+		for(size_t i=0;i<count;i++) {
+			table.Add(written + out.size(), totalBytes);
+			table.syncPoints.insert(table.syncPoints.end(), syncs[i].begin(), syncs[i].end());
+			totalBytes += blocks[i].size();
+			frame.rawSize = (uint32_t)blocks[i].size();
+			frame.payloadSize = (uint32_t)payloads[i].Bytes().size() + frame.MessageOffset();
+			frame.checksum = crcs[i];
+			frame.Write(out);
+			out.append(payloads[i].Bytes());
+		}
+		fOutput.write(out.data(), out.size());
+		if(fOutput.bad()) return 5;
+		written += out.size();
+		out.clear();
 	}
-	// in the previous loop we add one too many newlines, removed here
-	text.erase(text.size() - 1);
-
-	text.assign(Encode(text));
+	if(!totalBytes) return 3;
 
-	fOutput.write(text.c_str(), text.size());
+	THuffmanFrame end;
+	table.Add(written, totalBytes);
+	end.Write(out);
+	if(seekTable) table.Write(out);
+	fOutput.write(out.data(), out.size());
 	if(fOutput.bad()) return 5;
 	fOutput.flush();
 
+	__GatherStats(coders);
 	return 0;
 }
-inline int THuffman::Decode(const std::string & inputFile, const std::string & outputFile)
+inline int THuffman::_DecodeFile(const std::string & inputFile, const std::string & outputFile)
 {
+	// pipes and other files that can't be mapped are read as a stream
+	TMappedFile input;
+	if(!pipeline && input.OpenRead(inputFile))
+		return _DecodeMapped(input, outputFile);
+
 	std::ifstream fInput;
 	std::ofstream fOutput;
 
-	fInput.open(inputFile.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	fInput.open(inputFile.c_str(), std::ios::in | std::ios::binary);
 	if(!fInput.is_open()) return 1;
-	fOutput.open(outputFile.c_str(), std::ios::out | std::ios::trunc);
+	fOutput.open(outputFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
 
-	int r = Decode(fInput, fOutput);
+	int r = _DecodeStream(fInput, fOutput);
 
 	fInput.close();
 	fOutput.close();
 
 	return r;
 }
-inline int THuffman::Decode(std::ifstream & fInput, std::ofstream & fOutput)
+// read a frame at a time, only ever holding one block in memory
+inline int THuffman::_DecodeStream(std::ifstream & fInput, std::ofstream & fOutput)
 {
 	if(!fInput.is_open()) return 1;
 	if(!fOutput.is_open()) return 2;
+	badBlocks.clear();
+	haveTable = false;
+
+	unsigned char buf[THuffmanFrame::SIZE];
+	fInput.read((char *)buf, THuffmanStreamHeader::SIZE);
+	if(fInput.bad()) return 4;
+	if(fInput.gcount() == 0) return 3;
+	THuffmanStreamHeader header;
+	if(fInput.gcount() != THuffmanStreamHeader::SIZE || !header.Read(buf)) return 6;
+
+	// blocks that share tables have to be decoded in order, by one coder
+	bool inOrder = (header.flags & THuffmanStreamHeader::SHARED_TABLES) != 0;
+	if(pipeline)
+		return _DecodePipeline(fInput, fOutput, inOrder);
+	if((header.flags & THuffmanStreamHeader::SEEK_TABLE) && threads != 1 && !inOrder)
+		return _DecodeBlocks(fInput, fOutput);
+
+	std::string payload;
+	THuffmanFrame frame;
+	for(uint64_t block=0;;block++) {
+		fInput.read((char *)buf, THuffmanFrame::SIZE);
+		if(fInput.bad()) return 4;
+		if(fInput.gcount() != THuffmanFrame::SIZE || !frame.Read(buf)) return 6;
+		if(frame.type == THuffmanFrame::END) break;
+		// even a 63 bit code per byte can't make the payload this big
+		if(frame.payloadSize > (uint64_t)frame.rawSize * 8 + 1024) return 6;
+		if(frame.rawSize > THuffmanFrame::MAX_BLOCK_SIZE) return 6;
+
+		payload.resize(frame.payloadSize);
+		fInput.read(&payload[0], frame.payloadSize);
+		if(fInput.bad()) return 4;
+		if((uint32_t)fInput.gcount() != frame.payloadSize) return 6;
+
+		frame.ReadChecksum((const unsigned char *)payload.data());
+		encodedText.AssignBytes(payload.data() + frame.MessageOffset(), frame.payloadSize - frame.MessageOffset());
+		plainText.resize(frame.rawSize);
+		int r = _DecodeFrame(frame, &plainText[0]);
+		if(r == 6) return 6;
+		if(r == 8) badBlocks.push_back(block);
+
+		fOutput.write(plainText.data(), plainText.size());
+		if(fOutput.bad()) return 5;
+	}
+	fOutput.flush();
 
-	std::string text;
+	return badBlocks.empty() ? 0 : 8;
+}
+// with a seek table we know where every block is before reading any of
+// them. read a batch of blocks in one go, decode them all at once straight
+// into their place in the output, and write the lot out
+inline int THuffman::_DecodeBlocks(std::ifstream & fInput, std::ofstream & fOutput)
+{
+	THuffmanSeekTable table;
+	int r = _ReadSeekTable(fInput, table);
+	if(r) return r;
+
+	TWorkerPool workers(threads);
+	std::vector<THuffman> coders(workers.Size() - 1);
+	__ShareSettings(coders);
+	std::vector<char> failed(workers.Size()), bad(workers.Size());
+	std::string packed, text;
+
+	size_t blocks = table.Blocks();
+	for(size_t first=0;first<blocks;first+=workers.Size()) {
+		size_t last = std::min(blocks, first + workers.Size());
+		uint64_t packedStart = table.packedOffsets[first];
+		uint64_t rawStart = table.rawOffsets[first];
+		uint64_t packedBytes = table.packedOffsets[last] - packedStart;
+		uint64_t rawBytes = table.rawOffsets[last] - rawStart;
+		// the blocks are only checked once they are read, so a corrupt
+		// table mustn't get to ask for more than real frames could take up
+		// (no block is over MAX_BLOCK_SIZE, no payload over 8 bytes a letter
+		// and 1024 more, as _DecodeStream() checks)
+		if(rawBytes > (last - first) * (uint64_t)THuffmanFrame::MAX_BLOCK_SIZE ||
+			packedBytes > rawBytes * 8 + (last - first) * (uint64_t)(THuffmanFrame::SIZE + 1024)) return 6;
+
+		packed.resize(packedBytes);
+		fInput.seekg(packedStart);
+		fInput.read(&packed[0], packed.size());
+		if(fInput.bad()) return 4;
+		if((uint64_t)fInput.gcount() != packed.size()) return 6;
+		text.resize(rawBytes);
+
+		workers.Run(last - first, [&](size_t i, unsigned int worker) {
+			THuffman & coder = (worker == 0) ? *this : coders[worker - 1];
+			size_t block = first + i;
+			uint64_t offset = table.packedOffsets[block] - packedStart;
+			uint64_t size = table.packedOffsets[block + 1] - table.packedOffsets[block];
+			uint64_t rawSize = table.rawOffsets[block + 1] - table.rawOffsets[block];
+			const char *p = packed.data() + offset;
+			THuffmanFrame frame;
+			failed[i] = size < THuffmanFrame::SIZE || !frame.Read((const unsigned char *)p) ||
+				frame.type == THuffmanFrame::END || frame.rawSize != rawSize ||
+				frame.payloadSize != size - THuffmanFrame::SIZE;
+			if(failed[i]) return;
+			p += THuffmanFrame::SIZE;
+			frame.ReadChecksum((const unsigned char *)p);
+			coder.encodedText.AssignBytes(p + frame.MessageOffset(), frame.payloadSize - frame.MessageOffset());
+			int decoded = coder._DecodeFrame(frame, &text[table.rawOffsets[block] - rawStart]);
+			failed[i] = decoded == 6;
+			bad[i] = decoded == 8;
+		});
+		for(size_t i=0;i<last-first;i++) {
+			if(failed[i]) return 6;
+			if(bad[i]) badBlocks.push_back(first + i);
+		}
 
-	// get file size
+		fOutput.write(text.data(), text.size());
+		if(fOutput.bad()) return 5;
+	}
+	fOutput.flush();
+
+	__GatherStats(coders);
+	return badBlocks.empty() ? 0 : 8;
+}
+
+
+/*
+	-- implimentation note --
+	the blocks come from the seek table, or from walking the frame headers
+	and seeking past the payloads. each block holding part of the range is
+	decoded from its last sync point at or before the range, the letters
+	in front of the range are thrown away and decoding stops as soon as
+	the range is done. blocks that share tables need the headers of the
+	ones before them read too, which _FindBlocks() does on its way
+*/
+inline int THuffman::DecodeRange(const std::string & inputFile, uint64_t offset, uint64_t length, std::string & out)
+{
+	std::ifstream fInput(inputFile.c_str(), std::ios::in | std::ios::binary);
+	if(!fInput.is_open()) return 1;
+
+	unsigned char buf[THuffmanStreamHeader::SIZE];
+	fInput.read((char *)buf, THuffmanStreamHeader::SIZE);
+	if(fInput.bad()) return 4;
+	if(fInput.gcount() == 0) return 3;
+	THuffmanStreamHeader header;
+	if(fInput.gcount() != THuffmanStreamHeader::SIZE || !header.Read(buf)) return 6;
+
+	haveTable = false;
+	bool shared = (header.flags & THuffmanStreamHeader::SHARED_TABLES) != 0;
+	uint64_t end = (length > ~offset) ? ~(uint64_t)0 : offset + length;
+	THuffmanSeekTable table;
+	int r = ((header.flags & THuffmanStreamHeader::SEEK_TABLE) && !shared) ?
+		_ReadSeekTable(fInput, table) : _FindBlocks(fInput, table, offset, end, shared);
+	if(r) return r;
+	if(offset > table.rawOffsets.back()) return 9;
+	end = std::min(end, table.rawOffsets.back());
+
+	std::string packed;
+	for(size_t b=0;b<table.Blocks() && table.rawOffsets[b]<end;b++) {
+		uint64_t blockStart = table.rawOffsets[b], blockEnd = table.rawOffsets[b + 1];
+		if(blockEnd <= offset) continue;
+
+		packed.resize(table.packedOffsets[b + 1] - table.packedOffsets[b]);
+		fInput.clear();
+		fInput.seekg(table.packedOffsets[b]);
+		fInput.read(&packed[0], packed.size());
+		if(fInput.bad()) return 4;
+		if((uint64_t)fInput.gcount() != packed.size()) return 6;
+		THuffmanFrame frame;
+		if(packed.size() < THuffmanFrame::SIZE || !frame.Read((const unsigned char *)packed.data()) ||
+			frame.type == THuffmanFrame::END || frame.rawSize != blockEnd - blockStart ||
+			frame.payloadSize != packed.size() - THuffmanFrame::SIZE) return 6;
+		unsigned int skipped = THuffmanFrame::SIZE + frame.MessageOffset();
+		encodedText.AttachBytes((const unsigned char *)packed.data() + skipped, packed.size() - skipped);
+		if(!_ReadHeader()) {
+			__CleanUp();
+			return 6;
+		}
+
+		// the last sync point at or before the range, if it has one
+		uint64_t from = std::max(offset, blockStart) - blockStart, to = std::min(end, blockEnd) - blockStart;
+		uint64_t start = 0, skip = from;
+		unsigned char previous = 0;
+		size_t first, count;
+		table.SyncRange(b, first, count);
+		uint64_t k = table.syncInterval ? std::min<uint64_t>(from / table.syncInterval, count) : 0;
+		if(k > 0 && table.syncPoints[first + k - 1] != THuffmanSeekTable::NO_SYNC) {
+			uint64_t point = table.syncPoints[first + k - 1];
+			start = point & (((uint64_t)1 << 56) - 1);
+			previous = (unsigned char)(point >> 56);
+			skip = from - k * table.syncInterval;
+		}
+
+		bool ok;
+		if(streamed) {
+			// the substreams are not in letter order, so all of the block
+			plainText.resize(frame.rawSize);
+			ok = streamLetters == frame.rawSize && _DecodeStreams(&plainText[0], frame.rawSize);
+			if(ok) out.append(plainText, from, to - from);
+		} else {
+			ok = _DecodeSpan(start, previous, skip, to - from, out);
+		}
+		__CleanUp();
+		if(!ok) return 6;
+	}
+	encodedText.Clear();
+	return 0;
+}
+// after the header has been read, appends 'count' letters of the body to
+// 'out' after throwing 'skip' away. if bit 'start' of the message is past
+// the header, decoding starts from there, 'previous' being the letter
+// before it
+inline bool THuffman::_DecodeSpan(uint64_t start, unsigned char previous, uint64_t skip, uint64_t count, std::string & out)
+{
+	if(start > encodedText.Position()) {
+		if(start - encodedText.Position() > encodedText.Size()) return false;
+		encodedText.Seek(start);
+	}
+	uint64_t left = encodedText.Size();
+	if(stored) {
+		if(skip + count > left / 8) return false;
+		out.append((const char *)encodedText.Data() + encodedText.Position() / 8 + skip, count);
+		return true;
+	}
+
+	size_t at = out.size();
+	out.resize(at + count);
+	unsigned char letter = previous;
+	for(uint64_t i=0;i<skip+count;i++) {
+		const TDecodeTable & table = contextMode ? contextDecoders[contextMap[letter]] : codeTable;
+		// a code running off the end means the block was cut short
+		if(!table.Decode(encodedText, letter) || encodedText.Size() > left) {
+			out.resize(at);
+			return false;
+		}
+		left = encodedText.Size();
+		if(i >= skip) out[at + (i - skip)] = (char)letter;
+	}
+	return true;
+}
+// without a seek table, walk the frames from the start, seeking past each
+// payload, until the end frame or the first block starting at or after
+// 'end'. with 'headers' the header of each block wholly before 'offset'
+// is read too, for blocks sharing tables
+inline int THuffman::_FindBlocks(std::ifstream & fInput, THuffmanSeekTable & table, uint64_t offset, uint64_t end, bool headers)
+{
+	// longer than any header a block that shares tables can have
+	enum { HEADER_BYTES = 512 };
+	unsigned char buf[THuffmanFrame::SIZE];
+	std::string prefix;
+	uint64_t pos = THuffmanStreamHeader::SIZE, raw = 0;
+	THuffmanFrame frame;
+	for(;;) {
+		table.Add(pos, raw);
+		if(raw >= end) break;
+		fInput.clear();
+		fInput.seekg(pos);
+		fInput.read((char *)buf, THuffmanFrame::SIZE);
+		if(fInput.bad()) return 4;
+		if(fInput.gcount() != THuffmanFrame::SIZE || !frame.Read(buf)) return 6;
+		if(frame.type == THuffmanFrame::END) break;
+
+		if(headers && raw + frame.rawSize <= offset) {
+			prefix.resize(std::min<uint32_t>(frame.payloadSize, HEADER_BYTES));
+			fInput.read(&prefix[0], prefix.size());
+			if(fInput.bad()) return 4;
+			if((size_t)fInput.gcount() != prefix.size()) return 6;
+			unsigned int skipped = frame.MessageOffset();
+			encodedText.AttachBytes((const unsigned char *)prefix.data() + skipped, prefix.size() - skipped);
+			bool ok = _ReadHeader();
+			__CleanUp();
+			if(!ok) return 6;
+		}
+		pos += THuffmanFrame::SIZE + frame.payloadSize;
+		raw += frame.rawSize;
+	}
+	return 0;
+}
+
+
+// reads the seek table from the end of the file, and the sync points in
+// front of it if there are any
+inline int THuffman::_ReadSeekTable(std::ifstream & fInput, THuffmanSeekTable & table)
+{
+	unsigned char trailer[THuffmanSeekTable::SYNC_TRAILER_SIZE];
 	fInput.seekg(0, std::ios::end);
-	std::fstream::pos_type totalBytes = fInput.tellg();
-	fInput.seekg(0, std::ios::beg);
+	uint64_t fileSize = fInput.tellg();
+	if(fileSize < THuffmanStreamHeader::SIZE + THuffmanSeekTable::TRAILER_SIZE) return 6;
+	fInput.seekg(fileSize - THuffmanSeekTable::TRAILER_SIZE);
+	fInput.read((char *)trailer, THuffmanSeekTable::TRAILER_SIZE);
+	if(fInput.bad()) return 4;
 
-	if(!totalBytes) return 3;
+	uint64_t tableBytes = THuffmanSeekTable::ReadTrailer(trailer);
+	if(!tableBytes || tableBytes > fileSize - THuffmanSeekTable::TRAILER_SIZE) return 6;
+	uint64_t tableStart = fileSize - THuffmanSeekTable::TRAILER_SIZE - tableBytes;
+	std::string entries(tableBytes, '\0');
+	fInput.seekg(tableStart);
+	fInput.read(&entries[0], tableBytes);
+	if(fInput.bad()) return 4;
+	if(!table.Read((const unsigned char *)entries.data(), tableBytes, tableStart)) return 6;
 
-	char * buf = new char[totalBytes];
-	fInput.read(buf, totalBytes);
-	text.assign(buf, totalBytes);
-	delete[] buf;
+	table.syncInterval = 0;
+	if(tableStart < THuffmanStreamHeader::SIZE + THuffmanSeekTable::SYNC_TRAILER_SIZE) return 0;
+	uint64_t syncEnd = tableStart - THuffmanSeekTable::SYNC_TRAILER_SIZE;
+	fInput.seekg(syncEnd);
+	fInput.read((char *)trailer, THuffmanSeekTable::SYNC_TRAILER_SIZE);
 	if(fInput.bad()) return 4;
+	uint64_t syncBytes = table.ReadSyncTrailer(trailer);
+	if(!syncBytes) {
+		table.syncInterval = 0;
+		return 0;
+	}
+	if(syncBytes > syncEnd - THuffmanStreamHeader::SIZE) return 6;
+	std::string points(syncBytes, '\0');
+	fInput.seekg(syncEnd - syncBytes);
+	fInput.read(&points[0], syncBytes);
+	if(fInput.bad()) return 4;
+	return table.ReadSync((const unsigned char *)points.data(), syncBytes) ? 0 : 6;
+}
 
-	text.assign(Decode(text));
 
-	fOutput << text;
+// the same frames as _EncodeStream(), but reading the next blocks and
+// writing the last ones carry on while blocks are being encoded
+inline int THuffman::_EncodePipeline(std::ifstream & fInput, std::ofstream & fOutput)
+{
+	// enough blocks for every coder to have one on the go and one more
+	// waiting, plus one each being read and written
+	unsigned int workers = threads ? threads : TWorkerPool::HardwareThreads();
+	TPipeline<__PipelineBlock> stages(workers, workers * 2 + 2);
+	std::vector<THuffman> coders(stages.Workers());
+	syncEvery = seekTable ? syncInterval : 0;
+	__ShareSettings(coders);
+	coders[0].chainTables = coders.size() == 1 && __CanChain();
+
+	std::string out;
+	THuffmanStreamHeader header;
+	if(seekTable) header.flags |= THuffmanStreamHeader::SEEK_TABLE;
+	if(coders[0].chainTables) header.flags |= THuffmanStreamHeader::SHARED_TABLES;
+	header.Write(out);		// goes out with the first frame
+
+	unsigned long long totalBytes = 0, written = 0;
+	THuffmanSeekTable table;
+	table.syncInterval = syncEvery;
+	THuffmanFrame frame;
+	frame.type = checksums ? THuffmanFrame::HUFFMAN_CHECKED : THuffmanFrame::HUFFMAN;
+	int r = stages.Run(
+		[&](__PipelineBlock & block) {
+			if(!fInput) return -1;
+			block.text.resize(blockSize);
+			fInput.read(&block.text[0], blockSize);
+			if(fInput.bad()) return 4;
+			std::streamsize len = fInput.gcount();
+			if(len <= 0) return -1;
+			block.text.resize(len);
+			return 0;
+		},
+		[&](__PipelineBlock & block, unsigned int worker) {
+			THuffman & coder = coders[worker];
+			coder._Encode((const unsigned char *)block.text.data(), block.text.size(), checksums ? &block.frame.checksum : NULL);
+			coder.encodedText.Swap(block.bits);
+			__Swap(coder.syncBits, block.sync);
+		},
+		[&](__PipelineBlock & block) {
+			table.Add(written + out.size(), totalBytes);
+			table.syncPoints.insert(table.syncPoints.end(), block.sync.begin(), block.sync.end());
+			totalBytes += block.text.size();
+			frame.rawSize = (uint32_t)block.text.size();
+			frame.payloadSize = (uint32_t)block.bits.Bytes().size() + frame.MessageOffset();
+			frame.checksum = block.frame.checksum;
+			frame.Write(out);
+			fOutput.write(out.data(), out.size());
+			fOutput.write(block.bits.Bytes().data(), block.bits.Bytes().size());
+			if(fOutput.bad()) return 5;
+			written += out.size() + block.bits.Bytes().size();
+			out.clear();
+			return 0;
+		});
+	if(r) return r;
+	if(!totalBytes) return 3;
+
+	out.clear();
+	THuffmanFrame end;
+	table.Add(written, totalBytes);
+	end.Write(out);
+	if(seekTable) table.Write(out);
+	fOutput.write(out.data(), out.size());
 	if(fOutput.bad()) return 5;
 	fOutput.flush();
 
+	__GatherStats(coders);
+	return 0;
+}
+// the same as _DecodeStream(), with the frames read and the blocks
+// written while others are being decoded. the stream header has been read,
+// 'inOrder' if it says the blocks share tables
+inline int THuffman::_DecodePipeline(std::ifstream & fInput, std::ofstream & fOutput, bool inOrder)
+{
+	unsigned int workers = threads ? threads : TWorkerPool::HardwareThreads();
+	if(inOrder) workers = 1;
+	TPipeline<__PipelineBlock> stages(workers, workers * 2 + 2);
+	std::vector<THuffman> coders(stages.Workers());
+	__ShareSettings(coders);
+
+	unsigned char buf[THuffmanFrame::SIZE];
+	THuffmanFrame frame;
+	uint64_t blocks = 0;
+	int r = stages.Run(
+		[&](__PipelineBlock & block) {
+			fInput.read((char *)buf, THuffmanFrame::SIZE);
+			if(fInput.bad()) return 4;
+			if(fInput.gcount() != THuffmanFrame::SIZE || !frame.Read(buf)) return 6;
+			if(frame.type == THuffmanFrame::END) return -1;
+			// even a 63 bit code per byte can't make the payload this big
+			if(frame.payloadSize > (uint64_t)frame.rawSize * 8 + 1024) return 6;
+			if(frame.rawSize > THuffmanFrame::MAX_BLOCK_SIZE) return 6;
+
+			block.packed.resize(frame.payloadSize);
+			fInput.read(&block.packed[0], frame.payloadSize);
+			if(fInput.bad()) return 4;
+			if((uint32_t)fInput.gcount() != frame.payloadSize) return 6;
+			frame.ReadChecksum((const unsigned char *)block.packed.data());
+			block.frame = frame;
+			return 0;
+		},
+		[&](__PipelineBlock & block, unsigned int worker) {
+			THuffman & coder = coders[worker];
+			unsigned int offset = block.frame.MessageOffset();
+			coder.encodedText.AttachBytes((const unsigned char *)block.packed.data() + offset, block.packed.size() - offset);
+			coder.plainText.resize(block.frame.rawSize);
+			int decoded = coder._DecodeFrame(block.frame, &coder.plainText[0]);
+			block.failed = decoded == 6;
+			block.bad = decoded == 8;
+			__Swap(block.text, coder.plainText);
+		},
+		[&](__PipelineBlock & block) {
+			if(block.failed) return 6;
+			if(block.bad) badBlocks.push_back(blocks);
+			blocks++;
+			fOutput.write(block.text.data(), block.text.size());
+			if(fOutput.bad()) return 5;
+			return 0;
+		});
+	if(r) return r;
+	fOutput.flush();
+
+	__GatherStats(coders);
+	return badBlocks.empty() ? 0 : 8;
+}
+
+
+// the same as Encode(ifstream &, ofstream &) but the blocks are read
+// straight out of the mapped input, and each batch of frames is handed to
+// the system in one gathered write straight out of the coders' buffers
+inline int THuffman::_EncodeMapped(const TMappedFile & input, const std::string & outputFile)
+{
+	TFileWriter output;
+	if(!output.Open(outputFile)) return 2;
+	if(input.Size() == 0) return 3;
+
+	TWorkerPool workers(threads);
+	std::vector<THuffman> coders(workers.Size() - 1);
+	syncEvery = seekTable ? syncInterval : 0;
+	__ShareSettings(coders);
+	std::vector<TBitBuffer> payloads(workers.Size());
+	std::vector<uint32_t> crcs(workers.Size());
+	std::vector<std::pmr::vector<uint64_t> > syncs(workers.Size());
+	chainTables = workers.Size() == 1 && __CanChain();
+	haveSent = false;
+
+	THuffmanStreamHeader header;
+	if(seekTable) header.flags |= THuffmanStreamHeader::SEEK_TABLE;
+	if(chainTables) header.flags |= THuffmanStreamHeader::SHARED_TABLES;
+	std::string headers;
+	header.Write(headers);
+
+	uint64_t blocks = (input.Size() + blockSize - 1) / blockSize;
+	uint64_t written = 0;
+	THuffmanSeekTable table;
+	table.syncInterval = syncEvery;
+	THuffmanFrame frame;
+	frame.type = checksums ? THuffmanFrame::HUFFMAN_CHECKED : THuffmanFrame::HUFFMAN;
+	unsigned int frameSize = THuffmanFrame::SIZE + frame.MessageOffset();
+	for(uint64_t first=0;first<blocks;first+=workers.Size()) {
+		size_t count = (size_t)std::min<uint64_t>(blocks - first, workers.Size());
+		workers.Run(count, [&](size_t i, unsigned int worker) {
+			THuffman & coder = (worker == 0) ? *this : coders[worker - 1];
+			uint64_t start = (first + i) * blockSize;
+			uint64_t len = std::min<uint64_t>(blockSize, input.Size() - start);
+			coder._Encode(input.Data() + start, len, checksums ? &crcs[i] : NULL);
+			coder.encodedText.Swap(payloads[i]);
+			__Swap(coder.syncBits, syncs[i]);
+		});
+
+		// the frame headers go in one string, so write them all before
+		// pointing the writer at them
+		size_t headerStart = headers.size();
+		for(size_t i=0;i<count;i++) {
+			uint64_t start = (first + i) * blockSize;
+			frame.rawSize = (uint32_t)std::min<uint64_t>(blockSize, input.Size() - start);
+			frame.payloadSize = (uint32_t)payloads[i].Bytes().size() + frame.MessageOffset();
+			frame.checksum = crcs[i];
+			frame.Write(headers);
+		}
+		output.Append(headers.data(), headerStart);
+		written += headerStart;
+		for(size_t i=0;i<count;i++) {
+			table.Add(written, (first + i) * blockSize);
+			table.syncPoints.insert(table.syncPoints.end(), syncs[i].begin(), syncs[i].end());
+			output.Append(headers.data() + headerStart + i * frameSize, frameSize);
+			output.Append(payloads[i].Bytes().data(), payloads[i].Bytes().size());
+			written += frameSize + payloads[i].Bytes().size();
+		}
+		if(!output.Flush()) return 5;
+		headers.clear();
+	}
+
+	THuffmanFrame end;
+	table.Add(written, input.Size());
+	end.Write(headers);
+	if(seekTable) table.Write(headers);
+	output.Append(headers.data(), headers.size());
+	if(!output.Flush()) return 5;
+
+	__GatherStats(coders);
 	return 0;
 }
+// the frame headers alone say where every block goes in the output, so
+// walk them first, create the output at its final size, then decode every
+// block at once straight from the mapped input into its place in the
+// mapped output
+inline int THuffman::_DecodeMapped(const TMappedFile & input, const std::string & outputFile)
+{
+	badBlocks.clear();
+	haveTable = false;
+	TMappedFile output;
+	if(input.Size() == 0) return output.Create(outputFile, 0) ? 3 : 2;
+	const unsigned char *data = input.Data();
+
+	THuffmanStreamHeader header;
+	if(input.Size() < THuffmanStreamHeader::SIZE || !header.Read(data)) return 6;
+
+	THuffmanSeekTable table;
+	THuffmanFrame frame;
+	uint64_t pos = THuffmanStreamHeader::SIZE, rawSize = 0;
+	for(;;) {
+		if(input.Size() - pos < THuffmanFrame::SIZE || !frame.Read(data + pos)) return 6;
+		table.Add(pos, rawSize);
+		if(frame.type == THuffmanFrame::END) break;
+		if(input.Size() - pos - THuffmanFrame::SIZE < frame.payloadSize) return 6;
+		pos += THuffmanFrame::SIZE + frame.payloadSize;
+		rawSize += frame.rawSize;
+	}
+
+	if(!output.Create(outputFile, rawSize)) return 2;
+
+	// blocks that share tables have to be decoded in order, by one coder
+	TWorkerPool workers((header.flags & THuffmanStreamHeader::SHARED_TABLES) ? 1 : threads);
+	std::vector<THuffman> coders(workers.Size() - 1);
+	__ShareSettings(coders);
+	std::vector<char> failed(table.Blocks()), bad(table.Blocks());
+	workers.Run(table.Blocks(), [&](size_t i, unsigned int worker) {
+		THuffman & coder = (worker == 0) ? *this : coders[worker - 1];
+		THuffmanFrame block;
+		block.Read(data + table.packedOffsets[i]);
+		const unsigned char *payload = data + table.packedOffsets[i] + THuffmanFrame::SIZE;
+		block.ReadChecksum(payload);
+		coder.encodedText.AttachBytes(payload + block.MessageOffset(), block.payloadSize - block.MessageOffset());
+		int decoded = coder._DecodeFrame(block, (char *)output.Data() + table.rawOffsets[i]);
+		failed[i] = decoded == 6;
+		bad[i] = decoded == 8;
+	});
+	for(size_t i=0;i<failed.size();i++) {
+		if(failed[i]) return 6;
+		if(bad[i]) badBlocks.push_back(i);
+	}
+
+	__GatherStats(coders);
+	return badBlocks.empty() ? 0 : 8;
+}
 
 
-// print out the trees in the forest in detail
+// print out the tree in detail
 inline void THuffman::__DebugForest()
 {
 	puts("_DebugForest()");
-	unsigned int forestSize = forest.size();
-	for(unsigned int i = 0; i < forestSize; i++)
-		forest.at(i)->Describe();
+	tree.Describe();
 }
 
 
-// free the memory we allocated
-// encoding makes the most mess
-inline void THuffman::__CleanUp()
+// add 'lap' to how long 'stage' has taken, and start the next lap
+inline void THuffman::__Lap(int stage, uint64_t & lap)
 {
-	//puts("_CleanUp()");
-
-	// there should only be one item in the forest at this point
-	// however, for compleatness, we shall check every element
-	// calling DestroyTree() on each
-	unsigned int forestSize = forest.size();
-	for(unsigned int i = 0; i < forestSize; i++)
-		forest.at(i)->DestroyTree();
+	if(!collectStats) return;
+	uint64_t now = THuffmanStats::Now();
+	stats.stageNanos[stage] += now - lap;
+	lap = now;
+}
+// the other coders of a file code their blocks the way we would
+inline void THuffman::__ShareSettings(std::vector<THuffman> & coders)
+{
+	for(size_t i=0;i<coders.size();i++) {
+		coders[i].maxCodeLength = maxCodeLength;
+		coders[i].interleave = interleave;
+		coders[i].contexts = contexts;
+		coders[i].checksums = checksums;
+		coders[i].minSaving = minSaving;
+		coders[i].reuseTables = reuseTables;
+		coders[i].syncEvery = syncEvery;
+		coders[i].collectStats = collectStats;
+		coders[i].stats.Clear();
+	}
+}
+// the helpers working on a file collect the same stats we do, and we
+// add them to ours once the file is done
+inline void THuffman::__GatherStats(std::vector<THuffman> & coders)
+{
+	if(!collectStats) return;
+	for(size_t i=0;i<coders.size();i++)
+		stats.Add(coders[i].stats);
+}
 
-	std::map<const char, TBitBuffer*>::iterator itr;
-	for(itr = bitTable.begin(); itr != bitTable.end(); itr++)
-		delete itr->second;
 
+// reset everything for the next message. the containers keep their
+// memory, so the next message of a similar size allocates nothing.
+// codeTable stays as it is, in case the next message repeats it
+inline void THuffman::__CleanUp()
+{
+	//puts("_CleanUp()");
+	tree.Clear();
 	forest.clear();
-	bitTable.clear();
-	freqTable.clear();
-	codeTable.clear();
+	freqTable.Clear();
+	streamed = false;
+	contextMode = false;
+	stored = false;
+	repeated = false;
 }
@@ -0,0 +1,43 @@
+// huffman_batch.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - batches of messages
+	THuffman::EncodeBatch() and DecodeBatch() work through many messages in
+	one call, writing them one after the other into a buffer the caller
+	owns. Once THuffman has seen a few messages its buffers are big enough
+	and nothing more is allocated, however many batches follow.
+
+	A batch can also share one table. It is built from the letters of every
+	message in the batch and written once, in front of the messages, as a
+	message with no body. The messages themselves then have no header, the
+	same as preset messages. Short records that look alike come out much
+	smaller that way, but only the whole batch can be decoded, not one
+	message on its own.
+
+	Usage Example:
+
+	THuffmanSlice records[1000];		// where each record is
+	THuffmanExtent packed[1000], table;
+	std::vector<unsigned char> out(1 << 20);
+	int err = huff.EncodeBatch(records, 1000, &out[0], out.size(), packed, &table);
+	// err is 7 if 'out' was too small. record i is now packed[i].len bytes
+	// at &out[packed[i].offset], the shared table table.len bytes at
+	// &out[table.offset]
+*/
+#pragma once
+#include <stddef.h>
+
+
+// a message of a batch, wherever it is
+struct THuffmanSlice {
+	const unsigned char *data;
+	size_t len;
+};
+
+// where a message went in a batch's output buffer
+struct THuffmanExtent {
+	size_t offset;
+	size_t len;
+};
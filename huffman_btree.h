@@ -5,150 +5,128 @@
 	--
 	Toby's Huffman Compression - THuffmanBTree
 	This class manages a Binary Tree specifically for use with THuffman.
-	There is nothing particually remarkable about this BTree. Maybe only
-	the BitCode() function to return the path to a character.
+	A huffman tree over 256 letters never has more than 511 nodes, so they
+	all live in one fixed array and refer to their children by index. The
+	same tree can be cleared and reused for every message, nothing is
+	allocated while building it.
+
+	Nodes are only ever added after their children, so walking the array
+	backwards from the root visits every parent before its children. That
+	is all CodeLengths() needs to find the depth of each letter.
+
+	Usage Example:
+
+	THuffmanBTree tree;
+	unsigned short a = tree.AddLeaf('a', 5);
+	unsigned short b = tree.AddLeaf('b', 2);
+	unsigned short c = tree.AddLeaf('c', 1);
+	unsigned short bc = tree.AddNode(c, b);
+	tree.AddNode(bc, a);			// the last node added is the root
+
+	unsigned char lengths[256] = { 0 };
+	tree.CodeLengths(lengths);		// a = 1, b = 2, c = 2
 */
 #pragma once
+#include <stdint.h>
+#include <stdio.h>
 
 
 class THuffmanBTree {
 
-	public: 
+	public:
+
+		enum { MAX_NODES = 511, NONE = 0xFFFF };
 
 		struct node_t {
+			uint64_t totalFrequency;
+			unsigned short left;		// NONE for a leaf
+			unsigned short right;
 			unsigned char letter;
-			unsigned int totalFrequency;
-			node_t *left;
-			node_t *right;
 		};
 
 	private:
 
-		void			_Insert(unsigned char, unsigned int, node_t *);
-		std::string		_BitCode(unsigned char, node_t *, std::string);
-		void			_DestroyTree(node_t *);
-		void			_Describe(node_t *, unsigned int);
-	    
-		node_t			*root;
+		node_t			nodes[MAX_NODES];
+		unsigned short	size;
+
+		void			_Describe(unsigned short, unsigned int) const;
 
 	public:
 
-		THuffmanBTree() { root=NULL; }
-		~THuffmanBTree() { DestroyTree(); }
+		THuffmanBTree() { Clear(); }
 
-		void			Insert(unsigned char, unsigned int);
-		void			DefineRoot(const unsigned char, node_t *, node_t *);
-		std::string		BitCode(unsigned char a) { return _BitCode(a, root, ""); }
-		void			Describe() { _Describe(root, 0); }
-		void			DestroyTree() { _DestroyTree(root); }
+		void			Clear() { size = 0; }
 
-		// Getters and Setters
-		node_t			*GetRoot() { return root; }
-		unsigned char	GetRootLetter() { return root->letter; }
-		unsigned int	GetRootFreq() { return root->totalFrequency; }
-		void			SetRootFreq(unsigned int a) { root->totalFrequency = a; }
+		// both return the index of the new node
+		unsigned short	AddLeaf(unsigned char, uint64_t);
+		unsigned short	AddNode(unsigned short, unsigned short);
 
-};
+		// the depth of every letter in the tree, which is its code length
+		void			CodeLengths(unsigned char *) const;
+		void			Describe() const { if(size > 0) _Describe(GetRoot(), 0); }
 
+		// Getters and Setters
+		unsigned short	GetRoot() const { return size - 1; }
+		unsigned short	Size() const { return size; }
+		uint64_t		GetFreq(unsigned short n) const { return nodes[n].totalFrequency; }
+		const node_t	&GetNode(unsigned short n) const { return nodes[n]; }
 
-// set up the root node
-inline void THuffmanBTree::DefineRoot(const unsigned char _letter, node_t *newLeft, node_t *newRight)
-{
-	root = new node_t;
-	root->letter = _letter;
-	root->totalFrequency = newLeft->totalFrequency + newRight->totalFrequency;
-	root->left = newLeft;
-	root->right = newRight;
-}
+};
 
 
-// return the bitcode of a character by walking the path to it
-// this isn't as good as it could be.
-inline std::string THuffmanBTree::_BitCode(unsigned char needle, node_t *leaf, std::string bitCode)
+inline unsigned short THuffmanBTree::AddLeaf(const unsigned char _letter, const uint64_t _totalFrequency)
 {
-	if(leaf == NULL) return "";
-	if(leaf->letter == needle) return bitCode;
-	
-	// TODO: this could be improved
-	// we create too many string objects
-	std::string foo;
-	foo = _BitCode(needle, leaf->left, bitCode + "0");
-	if(foo.size() > 0) return foo;
-	foo = _BitCode(needle, leaf->right, bitCode + "1");
-	return foo;
+	node_t & leaf = nodes[size];
+	leaf.letter = _letter;
+	leaf.totalFrequency = _totalFrequency;
+	leaf.left = NONE;
+	leaf.right = NONE;
+	return size++;
 }
-
-
-// simple insert
-inline void THuffmanBTree::Insert(const unsigned char _letter, const unsigned int _totalFrequency)
+// join two nodes under a new parent
+inline unsigned short THuffmanBTree::AddNode(unsigned short newLeft, unsigned short newRight)
 {
-	//printf("Insert(%c, %u)\n", _letter, _totalFrequency);
-	if(root != NULL)
-		_Insert(_letter, _totalFrequency, root);
-	else {
-		root = new node_t;
-		root->letter = _letter;
-		root->totalFrequency = _totalFrequency;
-		root->left = NULL;
-		root->right = NULL;
-	}
+	node_t & parent = nodes[size];
+	parent.letter = 0;
+	parent.totalFrequency = nodes[newLeft].totalFrequency + nodes[newRight].totalFrequency;
+	parent.left = newLeft;
+	parent.right = newRight;
+	return size++;
 }
 
 
-// simple insert, with leaf node to search from
-inline void THuffmanBTree::_Insert(const unsigned char _letter, const unsigned int _totalFrequency, node_t *leaf)
+// one pass from the root back to the first leaf. every parent comes after
+// its children in the array, so its depth is known before theirs is needed
+inline void THuffmanBTree::CodeLengths(unsigned char *lengths) const
 {
-	//printf("Insert(%c, %u, NODE)\n", _letter, _totalFrequency);
-	if(leaf->totalFrequency > _totalFrequency) {
-		if(leaf->left != NULL)
-			_Insert(_letter, _totalFrequency, leaf->left);
-		else {
-			leaf->left = new node_t;		// We can add a new node here
-			leaf->left->letter = _letter;
-			leaf->left->totalFrequency = _totalFrequency;
-			leaf->left->left = NULL;		// Set the children of the new node to null
-			leaf->left->right = NULL;
-		}
-	} else if(leaf->totalFrequency <= _totalFrequency) {
-		if(leaf->right != NULL)
-			_Insert(_letter, _totalFrequency, leaf->right);
-		else {
-			leaf->right = new node_t;
-			leaf->right->letter = _letter;
-			leaf->right->totalFrequency = _totalFrequency;
-			leaf->right->left = NULL;
-			leaf->right->right = NULL;
+	if(size == 0) return;
+	unsigned char depth[MAX_NODES];
+	depth[GetRoot()] = 0;
+	for(int n=GetRoot();n>=0;n--) {
+		const node_t & node = nodes[n];
+		if(node.left == NONE) {
+			lengths[node.letter] = depth[n];
+		} else {
+			depth[node.left] = depth[n] + 1;
+			depth[node.right] = depth[n] + 1;
 		}
 	}
 }
 
 
-// with a given leaf node, delete all its children, then itself
-inline void THuffmanBTree::_DestroyTree(node_t *leaf)
-{
-	//printf("DestroyTree(NODE)\n");
-	if(leaf == NULL) return;
-	_DestroyTree(leaf->left);
-	_DestroyTree(leaf->right);
-	delete leaf;
-}
-
-
 // just for debug purposes
-inline void THuffmanBTree::_Describe(node_t *leaf, unsigned int depth)
+inline void THuffmanBTree::_Describe(unsigned short n, unsigned int depth) const
 {
-	if(leaf == NULL) return;
-
 	// draw our depth
 	for(unsigned int x = 0; x < depth; x++)
 		printf("--=");
 
 	// talk about ourself
-	unsigned char tmp = leaf->letter;
-	if(tmp == NULL) tmp = '+';
-	printf("%c(%u)\n", tmp, leaf->totalFrequency);
+	const node_t & node = nodes[n];
+	unsigned char tmp = (node.left == NONE) ? node.letter : '+';
+	printf("%c(%llu)\n", tmp, (unsigned long long)node.totalFrequency);
 
 	// move on
-	if(leaf->left != NULL) _Describe(leaf->left, depth+1);
-	if(leaf->right != NULL) _Describe(leaf->right, depth+1);
+	if(node.left != NONE) _Describe(node.left, depth+1);
+	if(node.right != NONE) _Describe(node.right, depth+1);
 }
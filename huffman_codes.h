@@ -0,0 +1,110 @@
+// huffman_codes.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - code length helpers
+	Canonical huffman codes are fully described by their lengths: letters
+	are sorted by code length, then by letter, and handed consecutive codes.
+	So only the lengths need to be stored and both sides regenerate the
+	same codes.
+
+	Usage Example:
+
+	unsigned char lengths[256] = { 0 };
+	lengths['a'] = 1; lengths['b'] = 2; lengths['c'] = 2;
+	uint64_t codes[256];
+	CanonicalCodes(lengths, codes);		// a = 0, b = 10, c = 11
+
+	// no code longer than 12 bits
+	LimitCodeLengths(lengths, frequencies, 12);
+
+	Both are constexpr, so code tables can also be worked out by the
+	compiler (see static_codebook.h).
+*/
+#pragma once
+#include <stdint.h>
+
+
+// the longest code length the header format can describe
+#define HUFFMAN_MAX_CODE_LENGTH 63
+
+
+// fill 'codes' with the canonical code of every letter with a non-zero length
+constexpr void CanonicalCodes(const unsigned char lengths[256], uint64_t codes[256])
+{
+	unsigned int lengthCount[HUFFMAN_MAX_CODE_LENGTH + 1] = { 0 };
+	for(int i=0;i<256;i++)
+		lengthCount[lengths[i]]++;
+	lengthCount[0] = 0;
+
+	// the first code of each length follows on from the last code of the
+	// previous length, with a 0 bit added to the end
+	uint64_t nextCode[HUFFMAN_MAX_CODE_LENGTH + 1] = { 0 };
+	uint64_t code = 0;
+	for(int len=1;len<=HUFFMAN_MAX_CODE_LENGTH;len++) {
+		code = (code + lengthCount[len-1]) << 1;
+		nextCode[len] = code;
+	}
+
+	for(int i=0;i<256;i++)
+		codes[i] = (lengths[i] > 0) ? nextCode[lengths[i]]++ : 0;
+}
+
+
+/*
+	huffman codes can get very long for letters that hardly ever appear,
+	which makes them slow to decode and awkward to write. this shortens
+	any code over 'maxLength' bits by moving the overflowing letters down to
+	'maxLength', then lengthening the shortest codes it can until the lengths
+	describe a valid prefix code again. the lengths are then handed back out
+	in order, shortest first to the most frequent letters.
+	'maxLength' must be at least 8 to fit all 256 letters.
+*/
+constexpr void LimitCodeLengths(unsigned char lengths[256], const uint64_t freqs[256], unsigned int maxLength)
+{
+	// tree depths can go past HUFFMAN_MAX_CODE_LENGTH with very skewed
+	// counts, so the overflowing letters are counted at 'maxLength' already
+	unsigned int lengthCount[HUFFMAN_MAX_CODE_LENGTH + 1] = { 0 };
+	unsigned int longest = 0;
+	for(int i=0;i<256;i++) {
+		lengthCount[(lengths[i] > maxLength) ? maxLength : lengths[i]]++;
+		if(lengths[i] > longest) longest = lengths[i];
+	}
+	if(longest <= maxLength) return;
+
+	// the kraft sum, measured in units of 2^-maxLength, must not exceed 1
+	uint64_t total = 0;
+	for(unsigned int len=1;len<=maxLength;len++)
+		total += (uint64_t)lengthCount[len] << (maxLength - len);
+	while(total > ((uint64_t)1 << maxLength)) {
+		// take a code off the longest length, and split a shorter code
+		// into two codes one bit longer to make room for it
+		lengthCount[maxLength]--;
+		for(unsigned int len=maxLength-1;len>0;len--) {
+			if(lengthCount[len] == 0) continue;
+			lengthCount[len]--;
+			lengthCount[len+1] += 2;
+			break;
+		}
+		total--;
+	}
+
+	// letters by frequency, most frequent first
+	unsigned char letters[256] = { 0 };
+	unsigned int used = 0;
+	for(int i=0;i<256;i++)
+		if(lengths[i] > 0) letters[used++] = (unsigned char)i;
+	for(unsigned int i=1;i<used;i++) {
+		unsigned char letter = letters[i];
+		unsigned int j = i;
+		for(;j>0 && freqs[letters[j-1]] < freqs[letter];j--)
+			letters[j] = letters[j-1];
+		letters[j] = letter;
+	}
+
+	unsigned int next = 0;
+	for(unsigned int len=1;len<=maxLength;len++)
+		for(unsigned int n=0;n<lengthCount[len];n++)
+			lengths[letters[next++]] = len;
+}
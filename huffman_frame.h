@@ -0,0 +1,235 @@
+// huffman_frame.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - file container
+	Files are encoded a block at a time so memory use does not depend on
+	the size of the file. Each block is an ordinary THuffman message wrapped
+	in a small frame header saying how big it is before and after encoding.
+
+	-- file format --
+	[stream header]<frames>[end frame][seek table]
+	[stream header]:
+		"THUF" [version, 1 byte] [flags, 1 byte]
+	<frames>:
+		[type, 1 byte] [raw size, 4 bytes] [payload size, 4 bytes] [payload]
+	[payload]:
+		HUFFMAN			a THuffman message
+		HUFFMAN_CHECKED	[CRC32C of the decoded block, 4 bytes] then the message,
+						the payload size counts the checksum too
+	[seek table]: only if the SEEK_TABLE flag is set
+		[sync points]<entries>[entry count, 8 bytes]"THSK"
+	<entries>:
+		[frame offset in the file, 8 bytes] [offset in the decoded output, 8 bytes]
+		one per frame, the last entry is for the end frame
+	[sync points]: only if "THSY" is right in front of <entries>
+		<points>[interval, 4 bytes][point count, 8 bytes]"THSY"
+	<points>:
+		[bit offset, 7 bytes] [letter before, 1 byte]
+		where the code of every interval-th letter of a block starts, from
+		the start of the block's message, and the letter before it (for
+		tables picked by context). a block of n letters has (n-1)/interval
+		of them, blocks follow each other. NO_SYNC if the block can't be
+		decoded from part way through
+	all numbers are little endian
+*/
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+// read/write little endian numbers of 'bytes' bytes
+inline void PutNumber(std::string & out, uint64_t value, unsigned int bytes)
+{
+	for(unsigned int i=0;i<bytes;i++)
+		out.append(1, (char)(value >> (8*i)));
+}
+inline uint64_t GetNumber(const unsigned char *in, unsigned int bytes)
+{
+	uint64_t value = 0;
+	for(unsigned int i=bytes;i>0;i--)
+		value = (value << 8) | in[i-1];
+	return value;
+}
+
+
+struct THuffmanStreamHeader {
+
+	enum { SIZE = 6, VERSION = 1 };
+	enum flags_t {
+		SEEK_TABLE = 0x01,		// the file ends with a THuffmanSeekTable
+		SHARED_TABLES = 0x02	// a block can be coded with the table of the block
+								// before it, so they must be decoded in order
+	};
+
+	unsigned char flags;
+
+	THuffmanStreamHeader() { flags = 0; }
+
+	void Write(std::string & out) const
+	{
+		out.append("THUF", 4);
+		out.append(1, (char)VERSION);
+		out.append(1, (char)flags);
+	}
+	// 'in' must hold at least SIZE bytes
+	bool Read(const unsigned char *in)
+	{
+		if(in[0] != 'T' || in[1] != 'H' || in[2] != 'U' || in[3] != 'F') return false;
+		if(in[4] != VERSION) return false;
+		flags = in[5];
+		return true;
+	}
+
+};
+
+
+struct THuffmanFrame {
+
+	enum { SIZE = 9, CHECKSUM_SIZE = 4 };
+	// the most a block can hold. decoders reject payloads of more than 8
+	// bytes a letter, so even a block this big fits the 32 bit sizes
+	enum { MAX_BLOCK_SIZE = 1 << 28 };
+	enum type_t {
+		END = 0,				// no more blocks follow
+		HUFFMAN = 1,			// payload is a THuffman message
+		HUFFMAN_CHECKED = 2		// payload is a checksum then a THuffman message
+	};
+
+	unsigned char type;
+	uint32_t rawSize;		// bytes once decoded
+	uint32_t payloadSize;	// bytes following this header
+	uint32_t checksum;		// only for HUFFMAN_CHECKED
+
+	THuffmanFrame() { type = END; rawSize = 0; payloadSize = 0; checksum = 0; }
+
+	// how far into the payload the message starts
+	unsigned int MessageOffset() const { return (type == HUFFMAN_CHECKED) ? CHECKSUM_SIZE : 0; }
+	// the header, and the checksum if there is one, so the message can
+	// follow straight on. 'payloadSize' must count the checksum
+	void Write(std::string & out) const
+	{
+		out.append(1, (char)type);
+		PutNumber(out, rawSize, 4);
+		PutNumber(out, payloadSize, 4);
+		if(type == HUFFMAN_CHECKED) PutNumber(out, checksum, CHECKSUM_SIZE);
+	}
+	// 'in' must hold at least SIZE bytes. the checksum is read with the
+	// payload, by ReadChecksum()
+	bool Read(const unsigned char *in)
+	{
+		type = in[0];
+		rawSize = (uint32_t)GetNumber(in + 1, 4);
+		payloadSize = (uint32_t)GetNumber(in + 5, 4);
+		return type <= HUFFMAN_CHECKED && payloadSize >= MessageOffset();
+	}
+	void ReadChecksum(const unsigned char *payload)
+	{
+		if(type == HUFFMAN_CHECKED) checksum = (uint32_t)GetNumber(payload, CHECKSUM_SIZE);
+	}
+
+};
+
+
+// where every block is, so blocks can be found without reading the ones
+// in front of them
+struct THuffmanSeekTable {
+
+	enum { TRAILER_SIZE = 12, ENTRY_SIZE = 16, SYNC_TRAILER_SIZE = 16, SYNC_SIZE = 8 };
+	static const uint64_t NO_SYNC = ~(uint64_t)0;
+
+	std::vector<uint64_t> packedOffsets;	// where each frame starts in the file
+	std::vector<uint64_t> rawOffsets;		// where its block starts once decoded
+	// optional, letters between sync points or 0 for none
+	uint32_t syncInterval;
+	std::vector<uint64_t> syncPoints;
+
+	THuffmanSeekTable() { syncInterval = 0; }
+
+	void Clear() { packedOffsets.clear(); rawOffsets.clear(); syncPoints.clear(); }
+	void Add(uint64_t packed, uint64_t raw) { packedOffsets.push_back(packed); rawOffsets.push_back(raw); }
+	// blocks, not counting the entry for the end frame
+	size_t Blocks() const { return packedOffsets.empty() ? 0 : packedOffsets.size() - 1; }
+
+	// where the sync points of 'block' start in syncPoints, and how many
+	// it has
+	void SyncRange(size_t block, size_t & first, size_t & count) const
+	{
+		first = 0;
+		count = 0;
+		if(!syncInterval) return;
+		for(size_t i=0;i<=block;i++) {
+			first += count;
+			uint64_t letters = rawOffsets[i + 1] - rawOffsets[i];
+			count = letters ? (size_t)((letters - 1) / syncInterval) : 0;
+		}
+	}
+
+	void Write(std::string & out) const
+	{
+		if(syncInterval) {
+			for(size_t i=0;i<syncPoints.size();i++)
+				PutNumber(out, syncPoints[i], SYNC_SIZE);
+			PutNumber(out, syncInterval, 4);
+			PutNumber(out, syncPoints.size(), 8);
+			out.append("THSY", 4);
+		}
+		for(size_t i=0;i<packedOffsets.size();i++) {
+			PutNumber(out, packedOffsets[i], 8);
+			PutNumber(out, rawOffsets[i], 8);
+		}
+		PutNumber(out, packedOffsets.size(), 8);
+		out.append("THSK", 4);
+	}
+	// 'in' must hold the last TRAILER_SIZE bytes of the file, returns how
+	// many bytes of entries sit in front of it, or 0 if there is no table
+	static uint64_t ReadTrailer(const unsigned char *in)
+	{
+		if(in[8] != 'T' || in[9] != 'H' || in[10] != 'S' || in[11] != 'K') return 0;
+		uint64_t count = GetNumber(in, 8);
+		if(count > ((uint64_t)1 << 40)) return 0;
+		return count * ENTRY_SIZE;
+	}
+	// reads the entries in front of the trailer, checking they make sense
+	// for a file of 'fileSize' bytes
+	bool Read(const unsigned char *in, uint64_t bytes, uint64_t fileSize)
+	{
+		Clear();
+		size_t count = bytes / ENTRY_SIZE;
+		for(size_t i=0;i<count;i++) {
+			uint64_t packed = GetNumber(in + i*ENTRY_SIZE, 8);
+			uint64_t raw = GetNumber(in + i*ENTRY_SIZE + 8, 8);
+			if(i > 0 && (packed <= packedOffsets.back() || raw < rawOffsets.back() ||
+				raw - rawOffsets.back() > THuffmanFrame::MAX_BLOCK_SIZE)) return false;
+			if(packed >= fileSize) return false;
+			Add(packed, raw);
+		}
+		return count > 0;
+	}
+	// 'in' must hold the SYNC_TRAILER_SIZE bytes in front of the entries,
+	// returns how many bytes of points sit in front of that, or 0 if there
+	// are none
+	uint64_t ReadSyncTrailer(const unsigned char *in)
+	{
+		if(in[12] != 'T' || in[13] != 'H' || in[14] != 'S' || in[15] != 'Y') return 0;
+		syncInterval = (uint32_t)GetNumber(in, 4);
+		uint64_t count = GetNumber(in + 4, 8);
+		if(syncInterval == 0 || count > ((uint64_t)1 << 40)) return 0;
+		return count * SYNC_SIZE;
+	}
+	// reads the points in front of the sync trailer, there must be as many
+	// as the blocks have
+	bool ReadSync(const unsigned char *in, uint64_t bytes)
+	{
+		syncPoints.resize(bytes / SYNC_SIZE);
+		for(size_t i=0;i<syncPoints.size();i++)
+			syncPoints[i] = GetNumber(in + i*SYNC_SIZE, SYNC_SIZE);
+		if(Blocks() == 0) return syncPoints.empty();
+		size_t first, count;
+		SyncRange(Blocks() - 1, first, count);
+		return first + count == syncPoints.size();
+	}
+
+};
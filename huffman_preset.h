@@ -0,0 +1,143 @@
+// huffman_preset.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - THuffmanPreset
+	A code table worked out once from a sample of typical messages (see
+	THuffman::Train()) and then shared by every message like it. Messages
+	encoded with a preset carry no header and no table has to be built for
+	them, which is what makes short messages worth encoding.
+
+	Both sides need the same preset registered under the same id, so presets
+	are saved to a file or string and loaded again where they are needed.
+
+	-- preset format --
+	"THPR" [version, 1 byte] [id, 4 bytes] [code length of letters 0 to 255, 1 byte each]
+
+	Usage Example:
+
+	THuffman huff;
+	THuffmanPreset preset;
+	huff.Train(sampleRecords, 7, preset);
+	preset.Save("records.preset");
+
+	THuffman other;
+	THuffmanPreset loaded;
+	if(loaded.Load("records.preset")) other.AddPreset(loaded);
+	string encoded = other.Encode(record, 7);
+	string decoded = other.Decode(encoded, 7);
+*/
+#pragma once
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include "bit_buffer.h"
+#include "decode_table.h"
+#include "huffman_codes.h"
+#include "huffman_frame.h"
+
+
+class THuffmanPreset {
+
+	private:
+
+		enum { VERSION = 1, SIZE = 4 + 1 + 4 + 256 };
+
+		unsigned int		id;
+		unsigned char		lengths[256];
+		TBitBuffer::code_t	codes[256];
+		TDecodeTable		table;
+
+	public:
+
+		THuffmanPreset() { id = 0; for(int i=0;i<256;i++) { lengths[i] = 0; codes[i].bits = 0; codes[i].len = 0; } }
+
+		// takes the code lengths of a preset, returns false if they are not
+		// a usable prefix code
+		bool				Assign(unsigned int, const unsigned char *);
+
+		// to and from a string or file in the preset format
+		void				Write(std::string &) const;
+		bool				Read(const std::string &);
+		bool				Save(const std::string &) const;
+		bool				Load(const std::string &);
+
+		// Getters
+		unsigned int		Id() const { return id; }
+		// a letter with length 0 has no code and can't be encoded
+		unsigned int		Length(unsigned char letter) const { return lengths[letter]; }
+		uint64_t			Code(unsigned char letter) const { return codes[letter].bits; }
+		// all of them, for TBitBuffer::AppendCodes()
+		const unsigned char	*Lengths() const { return lengths; }
+		const TBitBuffer::code_t *Codes() const { return codes; }
+		const TDecodeTable	&Table() const { return table; }
+
+};
+
+
+inline bool THuffmanPreset::Assign(unsigned int newId, const unsigned char *newLengths)
+{
+	// the kraft sum, in units of 2^-HUFFMAN_MAX_CODE_LENGTH, must not be
+	// over 1 or the codes would overlap
+	const uint64_t one = (uint64_t)1 << HUFFMAN_MAX_CODE_LENGTH;
+	uint64_t total = 0;
+	unsigned int used = 0;
+	for(int i=0;i<256;i++) {
+		if(newLengths[i] == 0) continue;
+		if(newLengths[i] > HUFFMAN_MAX_CODE_LENGTH) return false;
+		total += one >> newLengths[i];
+		if(total > one) return false;
+		used++;
+	}
+	if(used == 0) return false;
+
+	id = newId;
+	uint64_t canonical[256];
+	for(int i=0;i<256;i++)
+		lengths[i] = newLengths[i];
+	CanonicalCodes(lengths, canonical);
+	for(int i=0;i<256;i++) {
+		codes[i].bits = canonical[i];
+		codes[i].len = lengths[i];
+	}
+	table.Clear();
+	table.Build(lengths);
+	return true;
+}
+
+
+inline void THuffmanPreset::Write(std::string & out) const
+{
+	out.append("THPR", 4);
+	out.append(1, (char)VERSION);
+	PutNumber(out, id, 4);
+	out.append((const char *)lengths, 256);
+}
+inline bool THuffmanPreset::Read(const std::string & in)
+{
+	if(in.size() != SIZE) return false;
+	const unsigned char *p = (const unsigned char *)in.data();
+	if(p[0] != 'T' || p[1] != 'H' || p[2] != 'P' || p[3] != 'R') return false;
+	if(p[4] != VERSION) return false;
+	return Assign((unsigned int)GetNumber(p + 5, 4), p + 9);
+}
+inline bool THuffmanPreset::Save(const std::string & file) const
+{
+	std::string out;
+	Write(out);
+	std::ofstream fOutput(file.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!fOutput.is_open()) return false;
+	fOutput.write(out.data(), out.size());
+	return !fOutput.bad();
+}
+inline bool THuffmanPreset::Load(const std::string & file)
+{
+	std::ifstream fInput(file.c_str(), std::ios::in | std::ios::binary);
+	if(!fInput.is_open()) return false;
+	std::string in(SIZE + 1, '\0');
+	fInput.read(&in[0], in.size());
+	if(fInput.bad()) return false;
+	in.resize(fInput.gcount());
+	return Read(in);
+}
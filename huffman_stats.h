@@ -0,0 +1,122 @@
+// huffman_stats.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - THuffmanStats
+	What THuffman did during one call to Encode() or Decode(): sizes, how
+	good the codes were and how long each stage took. A file is encoded as
+	many messages (one per block), their numbers are added together.
+
+	THuffman only collects these when asked to, see SetCollectStats() and
+	SetStatsCallback().
+
+	Usage Example:
+
+	THuffman huff;
+	huff.SetCollectStats(true);
+	huff.Encode(text);
+	const THuffmanStats & stats = huff.GetStats();
+	printf("%.3f bits per letter, entropy %.3f\n", stats.BitsPerSymbol(), stats.Entropy());
+*/
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+
+
+struct THuffmanStats {
+
+	enum stage_t {
+		HISTOGRAM, TREE_BUILD, TABLE_BUILD, HEADER_WRITE, BODY_ENCODE,	// encoding
+		HEADER_READ, BODY_DECODE,										// decoding
+		STAGES
+	};
+
+	uint64_t messages;
+	uint64_t inputBytes;		// message bytes, not counting a file's frames
+	uint64_t outputBytes;
+	uint64_t headerBits;		// including the padding
+	uint64_t bodyBits;
+	uint64_t letters;			// letters encoded or decoded
+	unsigned int symbols;		// most different letters in any one message
+	unsigned int maxCodeLength;
+	uint64_t codes;				// codes in all the headers
+	uint64_t codeLengthTotal;	// and their lengths added up
+	double entropyBits;			// each message's entropy times its letters
+	uint64_t stageNanos[STAGES];
+
+	THuffmanStats() { Clear(); }
+
+	void Clear()
+	{
+		messages = inputBytes = outputBytes = headerBits = bodyBits = letters = 0;
+		symbols = maxCodeLength = 0;
+		codes = codeLengthTotal = 0;
+		entropyBits = 0;
+		for(int i=0;i<STAGES;i++)
+			stageNanos[i] = 0;
+	}
+	void Add(const THuffmanStats & other)
+	{
+		messages += other.messages;
+		inputBytes += other.inputBytes;
+		outputBytes += other.outputBytes;
+		headerBits += other.headerBits;
+		bodyBits += other.bodyBits;
+		letters += other.letters;
+		if(other.symbols > symbols) symbols = other.symbols;
+		if(other.maxCodeLength > maxCodeLength) maxCodeLength = other.maxCodeLength;
+		codes += other.codes;
+		codeLengthTotal += other.codeLengthTotal;
+		entropyBits += other.entropyBits;
+		for(int i=0;i<STAGES;i++)
+			stageNanos[i] += other.stageNanos[i];
+	}
+
+	// the code lengths of one message, 0 for letters without a code
+	void AddCodeLengths(const unsigned char lengths[256])
+	{
+		for(int i=0;i<256;i++) {
+			if(lengths[i] == 0) continue;
+			codes++;
+			codeLengthTotal += lengths[i];
+			if(lengths[i] > maxCodeLength) maxCodeLength = lengths[i];
+		}
+	}
+	// the letter counts of one message
+	void AddLetterCounts(const uint64_t counts[256])
+	{
+		uint64_t total = 0;
+		unsigned int used = 0;
+		for(int i=0;i<256;i++) {
+			total += counts[i];
+			if(counts[i] > 0) used++;
+		}
+		if(used > symbols) symbols = used;
+		letters += total;
+		for(int i=0;i<256;i++)
+			if(counts[i] > 0) entropyBits += counts[i] * log2((double)total / counts[i]);
+	}
+
+	// the average length of a code, however often it is used
+	double AvgCodeLength() const { return codes ? (double)codeLengthTotal / codes : 0; }
+	// the fewest bits per letter a code built for each message could use
+	double Entropy() const { return letters ? entropyBits / letters : 0; }
+	// the bits per letter the body actually used
+	double BitsPerSymbol() const { return letters ? (double)bodyBits / letters : 0; }
+
+	static const char *StageName(int stage)
+	{
+		static const char *names[STAGES] = {
+			"histogram", "tree_build", "table_build", "header_write", "body_encode",
+			"header_read", "body_decode"
+		};
+		return names[stage];
+	}
+	static uint64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+};
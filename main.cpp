@@ -6,12 +6,40 @@
 	Toby's Huffman Compression - Main
 	A wrapper for the THuffman class so hu-mans can use it.
 */
+#include <stdlib.h>
+#include <string.h>
+#include <iterator>
+#if defined(_WIN32)
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+#include <fcntl.h>
 #include "huffman.h"
+#include "adaptive_huffman.h"
 
 
 void Usage(char *argv[])
 {
-	printf("Usage: %s -e|d [input file] [output file]\n", argv[0]);
+	printf("Usage: %s [options] -e|d [input file] [output file]\n", argv[0]);
+	printf("       %s [-i ID] -p [sample file] [preset file]\n", argv[0]);
+	puts("Options:");
+	puts("  -t N    work on N blocks at once, 0 for one per hardware thread");
+	puts("  -s      write a seek table, which lets -r go straight to its blocks");
+	puts("  -4      split each block into 4 substreams that decode faster");
+	puts("  -c      code each letter with a table chosen by the letter before it");
+	puts("  -k      give each block a checksum, which decoding checks");
+	puts("  -u      code a block with the table of the block before when that is");
+	puts("          smaller, for files that look the same all the way through");
+	puts("  -m      memory map the files, rather than reading, coding and writing");
+	puts("          them on separate threads at once");
+	puts("  -r OFFSET:LENGTH");
+	puts("          with -d, decode only these bytes of the file. the output file");
+	puts("          can be - for stdout. fastest on files encoded with -s");
+	puts("  -a      adaptive mode, one pass with no header. either file can be -");
+	puts("          for stdin/stdout, output is written as soon as it is ready");
+	puts("  -v      print statistics about the encoding when done");
+	puts("  -i ID   the id to give a preset trained with -p, 0 by default");
 }
 
 void HandleErr(unsigned int err)
@@ -32,28 +60,222 @@ void HandleErr(unsigned int err)
 		case 5:
 			puts("Write error.");
 			break;
+		case 6:
+			puts("Input is not a valid encoded file.");
+			break;
+		case 7:
+			puts("Output buffer too small.");
+			break;
+		case 8:
+			puts("Checksum mismatch, the decoded file is damaged.");
+			break;
+		case 9:
+			puts("Range starts past the end of the decoded file.");
+			break;
 		default:
 			puts("Unknown error.");
 	}
 }
 
 
+void PrintStats(const THuffmanStats & stats)
+{
+	printf("Messages:      %llu\n", (unsigned long long)stats.messages);
+	printf("Input Size:    %llu bytes\n", (unsigned long long)stats.inputBytes);
+	printf("Output Size:   %llu bytes\n", (unsigned long long)stats.outputBytes);
+	printf("Header Size:   %llu bits\n", (unsigned long long)stats.headerBits);
+	printf("Body Size:     %llu bits\n", (unsigned long long)stats.bodyBits);
+	printf("Characters:    %u\n", stats.symbols);
+	printf("Code Length:   %u max, %.2f average\n", stats.maxCodeLength, stats.AvgCodeLength());
+	printf("Bits/Letter:   %.4f (entropy %.4f)\n", stats.BitsPerSymbol(), stats.Entropy());
+	for(int i=0;i<THuffmanStats::STAGES;i++) {
+		if(stats.stageNanos[i] == 0) continue;
+		printf("  %-12s %10.3f ms\n", THuffmanStats::StageName(i), stats.stageNanos[i] / 1e6);
+	}
+}
+
+
+#if defined(_WIN32)
+	#define open _open
+	#define read _read
+	#define write _write
+	#define close _close
+	#define O_BINARY_FLAG _O_BINARY
+#else
+	#define O_BINARY_FLAG 0
+#endif
+
+// write all of 'out', however many goes it takes
+bool WriteAll(int fd, const std::string & out)
+{
+	size_t done = 0;
+	while(done < out.size()) {
+		int r = write(fd, out.data() + done, (unsigned int)(out.size() - done));
+		if(r <= 0) return false;
+		done += r;
+	}
+	return true;
+}
+
+// adaptive mode reads whatever is available, rather than waiting for a
+// full buffer, and passes on the result straight away
+int Adaptive(bool encode, const char *inputFile, const char *outputFile)
+{
+	int in = (strcmp(inputFile, "-") == 0) ? 0 : open(inputFile, O_RDONLY | O_BINARY_FLAG);
+	if(in < 0) return 1;
+	int out = (strcmp(outputFile, "-") == 0) ? 1 : open(outputFile, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY_FLAG, 0644);
+	if(out < 0) return 2;
+
+	TAdaptiveHuffman coder;
+	std::string result;
+	unsigned char buf[1 << 16];
+	int err = 0;
+	for(;;) {
+		int len = read(in, buf, sizeof(buf));
+		if(len < 0) {
+			err = 4;
+			break;
+		}
+		if(len == 0) {
+			if(encode)
+				coder.Finish(result);
+			else if(!coder.Finished())
+				err = 6;
+			if(!err && !WriteAll(out, result)) err = 5;
+			break;
+		}
+		if(encode) {
+			coder.Encode(buf, len, result);
+		} else if(!coder.Decode(buf, len, result)) {
+			err = 6;
+			break;
+		}
+		if(!WriteAll(out, result)) {
+			err = 5;
+			break;
+		}
+		result.clear();
+	}
+
+	if(in != 0) close(in);
+	if(out != 1) close(out);
+	return err;
+}
+
+
+// decode the bytes 'range' asks for, "offset:length", to 'outputFile' or
+// stdout for -
+int DecodeRange(THuffman & huff, const char *range, const char *inputFile, const char *outputFile)
+{
+	char *rest;
+	unsigned long long offset = strtoull(range, &rest, 10);
+	if(*rest != ':') return 6;
+	unsigned long long length = strtoull(rest + 1, NULL, 10);
+
+	std::string result;
+	int err = huff.DecodeRange(inputFile, offset, length, result);
+	if(err) return err;
+	int out = (strcmp(outputFile, "-") == 0) ? 1 : open(outputFile, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY_FLAG, 0644);
+	if(out < 0) return 2;
+	if(!WriteAll(out, result)) err = 5;
+	if(out != 1) close(out);
+	return err;
+}
+
+
+// train a preset on the whole of 'sampleFile'
+int TrainPreset(THuffman & huff, unsigned int id, const char *sampleFile, const char *presetFile)
+{
+	std::ifstream fInput(sampleFile, std::ios::in | std::ios::binary);
+	if(!fInput.is_open()) return 1;
+	std::string sample((std::istreambuf_iterator<char>(fInput)), std::istreambuf_iterator<char>());
+	if(fInput.bad()) return 4;
+	if(sample.empty()) return 3;
+
+	THuffmanPreset preset;
+	huff.Train(sample, id, preset);
+	return preset.Save(presetFile) ? 0 : 2;
+}
+
+
 int main(int argc, char *argv[])
 {
-	if(argc != 4) {
-		Usage(argv);
-	} else {
-		unsigned int err;
-		THuffman huff;
-		if(strcmp(argv[1], "-e") == 0) {
-			err = huff.Encode(argv[2], argv[3]);
-		} else if (strcmp(argv[1], "-d") == 0) {
-			err = huff.Decode(argv[2], argv[3]);
+	THuffman huff;
+	unsigned int presetId = 0;
+	bool adaptive = false;
+	const char *range = NULL;
+	// reading and writing overlap the coding, unless asked for -m
+	huff.SetPipeline(true);
+
+	// options come first, the last three arguments are always the
+	// mode and the two files
+	int arg = 1;
+	while(arg < argc - 3) {
+		if(strcmp(argv[arg], "-t") == 0 && arg + 1 < argc - 3) {
+			huff.SetThreads(atoi(argv[arg+1]));
+			arg += 2;
+		} else if(strcmp(argv[arg], "-s") == 0) {
+			huff.SetSeekTable(true);
+			arg++;
+		} else if(strcmp(argv[arg], "-i") == 0 && arg + 1 < argc - 3) {
+			presetId = strtoul(argv[arg+1], NULL, 10);
+			arg += 2;
+		} else if(strcmp(argv[arg], "-4") == 0) {
+			huff.SetInterleave(true);
+			arg++;
+		} else if(strcmp(argv[arg], "-c") == 0) {
+			huff.SetContexts(true);
+			arg++;
+		} else if(strcmp(argv[arg], "-k") == 0) {
+			huff.SetChecksums(true);
+			arg++;
+		} else if(strcmp(argv[arg], "-u") == 0) {
+			huff.SetReuseTables(true);
+			arg++;
+		} else if(strcmp(argv[arg], "-m") == 0) {
+			huff.SetPipeline(false);
+			arg++;
+		} else if(strcmp(argv[arg], "-r") == 0 && arg + 1 < argc - 3 && strchr(argv[arg+1], ':')) {
+			range = argv[arg+1];
+			arg += 2;
+		} else if(strcmp(argv[arg], "-a") == 0) {
+			adaptive = true;
+			arg++;
+		} else if(strcmp(argv[arg], "-v") == 0) {
+			huff.SetCollectStats(true);
+			arg++;
 		} else {
 			Usage(argv);
+			return 1;
 		}
-		if(err)
-			HandleErr(err);
 	}
+	if(argc - arg != 3) {
+		Usage(argv);
+		return 1;
+	}
+
+	unsigned int err;
+	if(adaptive && (strcmp(argv[arg], "-e") == 0 || strcmp(argv[arg], "-d") == 0)) {
+		err = Adaptive(argv[arg][1] == 'e', argv[arg+1], argv[arg+2]);
+	} else if(range && strcmp(argv[arg], "-d") == 0) {
+		err = DecodeRange(huff, range, argv[arg+1], argv[arg+2]);
+	} else if(strcmp(argv[arg], "-e") == 0) {
+		err = huff.Encode(argv[arg+1], argv[arg+2]);
+	} else if (strcmp(argv[arg], "-d") == 0) {
+		err = huff.Decode(argv[arg+1], argv[arg+2]);
+	} else if (strcmp(argv[arg], "-p") == 0) {
+		err = TrainPreset(huff, presetId, argv[arg+1], argv[arg+2]);
+	} else {
+		Usage(argv);
+		return 1;
+	}
+	if(err) {
+		HandleErr(err);
+		// the whole file was still decoded, say where the damage is
+		for(size_t i=0;i<huff.GetBadBlocks().size();i++)
+			printf("  block %llu\n", (unsigned long long)huff.GetBadBlocks()[i]);
+		return 1;
+	}
+	if(huff.GetCollectStats()) PrintStats(huff.GetStats());
 	return 0;
 }
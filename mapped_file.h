@@ -0,0 +1,209 @@
+// mapped_file.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - TMappedFile, TFileWriter
+	Binary safe file access without copying through stream buffers.
+	TMappedFile maps a whole file into memory, either an existing file to
+	read or a new file of a known size to fill in. TFileWriter collects
+	pieces of output that are already in memory and hands them to the
+	system in as few large writes as possible.
+
+	Only available on POSIX systems, elsewhere Supported() is false and
+	every Open/Create fails, so callers should fall back to fstreams.
+	OpenRead() also fails for anything but a regular file, such as a pipe,
+	whose size isn't known up front.
+
+	Usage Example:
+
+	TMappedFile in, out;
+	if(in.OpenRead("plain.file") && out.Create("copy.file", in.Size()))
+		memcpy(out.Data(), in.Data(), in.Size());
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#if !defined(_WIN32)
+	#include <fcntl.h>
+	#include <limits.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/uio.h>
+	#include <unistd.h>
+#endif
+
+
+class TMappedFile {
+
+	private:
+
+		int					fd;
+		unsigned char		*data;
+		uint64_t			size;
+
+		// not copyable, we own the mapping
+		TMappedFile(const TMappedFile &);
+		TMappedFile &operator=(const TMappedFile &);
+
+	public:
+
+		TMappedFile() { fd = -1; data = NULL; size = 0; }
+		~TMappedFile() { Close(); }
+
+		// false if the file can't be opened or isn't a regular file
+		bool				OpenRead(const std::string &);
+		// creates (or truncates) the file at exactly this size
+		bool				Create(const std::string &, uint64_t);
+		void				Close();
+
+		const unsigned char	*Data() const { return data; }
+		unsigned char		*Data() { return data; }
+		uint64_t			Size() const { return size; }
+
+		static bool			Supported();
+
+};
+
+
+class TFileWriter {
+
+	private:
+
+		struct piece_t {
+			const void *data;
+			size_t len;
+		};
+
+		int					fd;
+		std::vector<piece_t> pieces;
+
+		TFileWriter(const TFileWriter &);
+		TFileWriter &operator=(const TFileWriter &);
+
+	public:
+
+		TFileWriter() { fd = -1; }
+		~TFileWriter() { Close(); }
+
+		bool				Open(const std::string &);
+		void				Close();
+		// the memory must stay valid until the next Flush()
+		void				Append(const void *p, size_t len) { piece_t piece = { p, len }; if(len > 0) pieces.push_back(piece); }
+		// writes everything appended so far, returns false on error
+		bool				Flush();
+
+};
+
+
+#if !defined(_WIN32)
+
+inline bool TMappedFile::Supported() { return true; }
+
+inline bool TMappedFile::OpenRead(const std::string & path)
+{
+	Close();
+	// checked before opening too, so a fifo isn't opened (and its writer
+	// woken) only to be closed again
+	struct stat st;
+	if(stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+	fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0) return false;
+	if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		Close();
+		return false;
+	}
+	size = st.st_size;
+	if(size == 0) return true;		// nothing to map, but not an error
+	void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(p == MAP_FAILED) {
+		Close();
+		return false;
+	}
+	data = (unsigned char *)p;
+	// we read it front to back
+	madvise(data, size, MADV_SEQUENTIAL);
+	return true;
+}
+inline bool TMappedFile::Create(const std::string & path, uint64_t newSize)
+{
+	Close();
+	fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) return false;
+	if(newSize == 0) return true;
+	if(ftruncate(fd, newSize) != 0) {
+		Close();
+		return false;
+	}
+	void *p = mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(p == MAP_FAILED) {
+		Close();
+		return false;
+	}
+	data = (unsigned char *)p;
+	size = newSize;
+	return true;
+}
+inline void TMappedFile::Close()
+{
+	if(data != NULL) munmap(data, size);
+	if(fd >= 0) close(fd);
+	fd = -1;
+	data = NULL;
+	size = 0;
+}
+
+
+inline bool TFileWriter::Open(const std::string & path)
+{
+	Close();
+	fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	return fd >= 0;
+}
+inline void TFileWriter::Close()
+{
+	if(fd >= 0) close(fd);
+	fd = -1;
+	pieces.clear();
+}
+// hand the pieces over with writev, as many at a time as the system allows
+inline bool TFileWriter::Flush()
+{
+	std::vector<struct iovec> iov(pieces.size());
+	for(size_t i=0;i<pieces.size();i++) {
+		iov[i].iov_base = (void *)pieces[i].data;
+		iov[i].iov_len = pieces[i].len;
+	}
+	pieces.clear();
+
+	size_t next = 0;
+	while(next < iov.size()) {
+		int count = (iov.size() - next < IOV_MAX) ? (int)(iov.size() - next) : IOV_MAX;
+		ssize_t written = writev(fd, &iov[next], count);
+		if(written < 0) return false;
+		// skip whatever was written, it may have stopped part way
+		while(next < iov.size() && (size_t)written >= iov[next].iov_len) {
+			written -= iov[next].iov_len;
+			next++;
+		}
+		if(next < iov.size()) {
+			iov[next].iov_base = (char *)iov[next].iov_base + written;
+			iov[next].iov_len -= written;
+		}
+	}
+	return true;
+}
+
+#else
+
+inline bool TMappedFile::Supported() { return false; }
+inline bool TMappedFile::OpenRead(const std::string &) { return false; }
+inline bool TMappedFile::Create(const std::string &, uint64_t) { return false; }
+inline void TMappedFile::Close() {}
+inline bool TFileWriter::Open(const std::string &) { return false; }
+inline void TFileWriter::Close() { pieces.clear(); }
+inline bool TFileWriter::Flush() { return false; }
+
+#endif
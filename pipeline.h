@@ -0,0 +1,146 @@
+// pipeline.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - TPipeline
+	Reading, working on and writing a stream of items all at the same time.
+	One thread reads items, several work on them and the calling thread
+	writes them, in the order they were read. Waiting on a slow disk or
+	network is hidden behind the work, instead of added to it.
+
+	There are only ever 'depth' items, which go round and round between
+	the stages through TWorkQueues. The reader can't run further ahead of
+	the writer than that, so memory stays the same however long the
+	stream is.
+
+	Usage Example:
+
+	TPipeline<std::string> pipeline(4, 10);
+	int err = pipeline.Run(
+		[&](std::string & item) { return ReadNext(item); },		// 0, -1 at the end, or an error
+		[&](std::string & item, unsigned int worker) { Transform(item); },
+		[&](std::string & item) { return WriteOut(item); });		// 0 or an error
+*/
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "work_queue.h"
+
+
+template<class T>
+class TPipeline {
+
+	public:
+
+		// fills in the next item, returns 0, -1 if there are no more or an
+		// error code. called on the reader thread
+		typedef std::function<int(T &)> read_t;
+		// called on a worker thread, and which worker it is
+		typedef std::function<void(T &, unsigned int)> work_t;
+		// called in the order the items were read, returns 0 or an error code
+		typedef std::function<int(T &)> write_t;
+
+	private:
+
+		enum { STOP = ~0u };
+
+		std::vector<T>				items;
+		std::vector<uint64_t>		sequence;		// of each item, in reading order
+		unsigned int				workers;
+
+	public:
+
+		TPipeline(unsigned int workerCount, unsigned int depth) : items(depth), sequence(depth) { workers = workerCount ? workerCount : 1; }
+
+		// returns 0, or the first error code from reading or writing. after
+		// an error nothing more is read or written
+		int							Run(const read_t &, const work_t &, const write_t &);
+
+		unsigned int				Workers() const { return workers; }
+
+};
+
+
+/*
+	-- implimentation note --
+	items are passed around by their index. 'idle' holds the ones waiting
+	to be read into, so the reader stops when the writer falls behind. the
+	queues have room for every item and STOP marker at once, so only
+	popping ever waits. items can finish out of order, the writer holds
+	them in 'pending' by their sequence number until their turn, as no more
+	than 'depth' items are ever in between
+*/
+template<class T>
+inline int TPipeline<T>::Run(const read_t & read, const work_t & work, const write_t & write)
+{
+	unsigned int depth = items.size();
+	TWorkQueue<unsigned int> idle(depth), todo(depth + workers), done(depth + 1);
+	for(unsigned int i=0;i<depth;i++)
+		idle.Push(i);
+
+	std::atomic<bool> stopping(false);
+	std::atomic<uint64_t> total(0);
+	int readError = 0;
+
+	std::thread reader([&] {
+		uint64_t count = 0;
+		for(;;) {
+			unsigned int i;
+			idle.Pop(i);
+			int r = stopping ? -1 : read(items[i]);
+			if(r != 0) {
+				if(r > 0) readError = r;
+				break;
+			}
+			sequence[i] = count++;
+			todo.Push(i);
+		}
+		total = count;
+		for(unsigned int w=0;w<workers;w++)
+			todo.Push(STOP);
+		done.Push(STOP);
+	});
+	std::vector<std::thread> threads;
+	for(unsigned int w=0;w<workers;w++) {
+		threads.push_back(std::thread([&, w] {
+			for(;;) {
+				unsigned int i;
+				todo.Pop(i);
+				if(i == STOP) break;
+				work(items[i], w);
+				done.Push(i);
+			}
+		}));
+	}
+
+	// after an error keep taking items, without writing them, so nothing
+	// is left waiting on a full queue
+	int writeError = 0;
+	std::vector<unsigned int> pending(depth, STOP);
+	uint64_t next = 0;
+	bool readAll = false;
+	while(!readAll || next < total) {
+		unsigned int i;
+		done.Pop(i);
+		if(i == STOP) {
+			readAll = true;
+			continue;
+		}
+		pending[sequence[i] % depth] = i;
+		for(unsigned int j;(j = pending[next % depth]) != STOP;next++) {
+			pending[next % depth] = STOP;
+			if(writeError == 0) writeError = write(items[j]);
+			if(writeError != 0) stopping = true;
+			idle.Push(j);
+		}
+	}
+
+	reader.join();
+	for(size_t w=0;w<threads.size();w++)
+		threads[w].join();
+	return readError ? readError : writeError;
+}
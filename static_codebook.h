@@ -0,0 +1,300 @@
+// static_codebook.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - TStaticCodebook
+	A code table the compiler works out. Some channels always carry the
+	same kind of text (English, JSON, hex dumps) so the letter counts are
+	known before the program is even built. A model gives those counts and
+	the tree, canonical codes and decode table are all made at compile time,
+	ending up in read only data. There is nothing to build or allocate at
+	run time, and the encoder and decoder are made for that one table so
+	the compiler knows how long its longest code is.
+
+	Messages are the same as THuffman's preset messages, so a
+	THuffmanPreset made from Lengths() decodes them too.
+
+	-- models --
+	a model is a struct with MAX_LENGTH, the longest code allowed (the
+	decode table has 2^MAX_LENGTH entries), and a constexpr Frequency() for
+	each letter. letters with a frequency of 0 get no code and can't be
+	encoded.
+
+	Usage Example:
+
+	std::string packed, plain;
+	if(!TStaticEnglish::Encode((const unsigned char *)"peter piper", 11, packed))
+		return;		// a letter the model has no code for
+	TStaticEnglish::Decode((const unsigned char *)packed.data(), packed.size(), plain);
+
+	// the same message through THuffman
+	THuffmanPreset preset;
+	preset.Assign(7, TStaticEnglish::Lengths());
+	huff.AddPreset(preset);
+	plain = huff.Decode(packed, 7);
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include "huffman_codes.h"
+
+
+template<class Model>
+class TStaticCodebook {
+
+	public:
+
+		enum { MAX_LENGTH = Model::MAX_LENGTH };
+
+	private:
+
+		static_assert(MAX_LENGTH >= 8 && MAX_LENGTH <= 16, "MAX_LENGTH must fit 256 letters and a small decode table");
+
+		struct entry_t {
+			unsigned char letter;
+			unsigned char len;		// 0 for a slot no code starts
+		};
+		struct tables_t {
+			unsigned char lengths[256];
+			uint32_t codes[256];
+			unsigned int shortest;
+			// indexed by the next MAX_LENGTH bits of the body
+			entry_t decode[1 << MAX_LENGTH];
+		};
+
+		static constexpr tables_t _Build();
+		static constexpr tables_t tables = _Build();
+
+	public:
+
+		// appends a message to 'out', returns false if a letter has no code
+		static bool					Encode(const unsigned char *, size_t, std::string &);
+		// appends the letters of a message to 'out', returns false if it is
+		// not a valid message
+		static bool					Decode(const unsigned char *, size_t, std::string &);
+
+		static const unsigned char	*Lengths() { return tables.lengths; }
+
+};
+
+
+/*
+	-- implimentation note --
+	the same two queue tree building as THuffman::_BuildBitTree(), with
+	plain arrays in place of THuffmanBTree. nodes 0-255 are the letters,
+	the ones made by joining two trees follow on from 256, so a node's
+	parent is always after it and depths can be filled in backwards
+*/
+template<class Model>
+constexpr typename TStaticCodebook<Model>::tables_t TStaticCodebook<Model>::_Build()
+{
+	tables_t r = {};
+
+	uint64_t freqs[256] = { 0 };
+	unsigned short forest[256] = { 0 };
+	unsigned int leaves = 0;
+	for(unsigned int i=0;i<256;i++) {
+		freqs[i] = Model::Frequency(i);
+		if(freqs[i] == 0) continue;
+		// lightest first, ties in letter order
+		unsigned int j = leaves++;
+		for(;j>0 && freqs[forest[j-1]] > freqs[i];j--)
+			forest[j] = forest[j-1];
+		forest[j] = (unsigned short)i;
+	}
+
+	uint64_t weight[511] = { 0 };
+	unsigned short parent[511] = { 0 };
+	for(unsigned int i=0;i<256;i++)
+		weight[i] = freqs[i];
+	unsigned int nextLeaf = 0, nextMerged = 256, nodes = 256;
+	while((leaves - nextLeaf) + (nodes - nextMerged) > 1) {
+		unsigned int lowest[2] = { 0, 0 };
+		for(int i=0;i<2;i++) {
+			if(nextMerged == nodes || (nextLeaf < leaves && weight[forest[nextLeaf]] <= weight[nextMerged]))
+				lowest[i] = forest[nextLeaf++];
+			else
+				lowest[i] = nextMerged++;
+		}
+		weight[nodes] = weight[lowest[0]] + weight[lowest[1]];
+		parent[lowest[0]] = parent[lowest[1]] = (unsigned short)nodes;
+		nodes++;
+	}
+
+	unsigned int depth[511] = { 0 };
+	for(unsigned int n=nodes-1;n>256;n--)
+		depth[n-1] = depth[parent[n-1]] + 1;
+	for(unsigned int i=0;i<leaves;i++)
+		r.lengths[forest[i]] = (leaves == 1) ? 1 : depth[parent[forest[i]]] + 1;
+	LimitCodeLengths(r.lengths, freqs, MAX_LENGTH);
+
+	uint64_t codes[256] = { 0 };
+	CanonicalCodes(r.lengths, codes);
+	r.shortest = MAX_LENGTH;
+	for(unsigned int i=0;i<256;i++) {
+		if(r.lengths[i] == 0) continue;
+		r.codes[i] = (uint32_t)codes[i];
+		if(r.lengths[i] < r.shortest) r.shortest = r.lengths[i];
+		// every slot starting with this code decodes to the letter
+		unsigned int first = r.codes[i] << (MAX_LENGTH - r.lengths[i]);
+		unsigned int last = first + (1 << (MAX_LENGTH - r.lengths[i]));
+		for(unsigned int j=first;j<last;j++) {
+			r.decode[j].letter = (unsigned char)i;
+			r.decode[j].len = r.lengths[i];
+		}
+	}
+	return r;
+}
+
+
+// the padding goes first, as in THuffman::_EncodeHeaderless(), then the codes
+// through a 64-bit accumulator straight into 'out'
+template<class Model>
+inline bool TStaticCodebook<Model>::Encode(const unsigned char *data, size_t len, std::string & out)
+{
+	uint64_t bodyBits = 0;
+	for(size_t i=0;i<len;i++) {
+		if(tables.lengths[data[i]] == 0) return false;
+		bodyBits += tables.lengths[data[i]];
+	}
+
+	size_t start = out.size();
+	out.resize(start + bodyBits / 8 + 1);
+	unsigned char *p = (unsigned char *)&out[start];
+
+	// 0s then a 1, so the message ends on a byte boundary
+	uint64_t accumulator = 1;
+	unsigned int bits = 8 - (unsigned int)(bodyBits % 8);
+	for(size_t i=0;i<len;i++) {
+		accumulator = (accumulator << tables.lengths[data[i]]) | tables.codes[data[i]];
+		bits += tables.lengths[data[i]];
+		if(bits >= 32) {
+			bits -= 32;
+			uint32_t word = (uint32_t)(accumulator >> bits);
+			p[0] = (unsigned char)(word >> 24);
+			p[1] = (unsigned char)(word >> 16);
+			p[2] = (unsigned char)(word >> 8);
+			p[3] = (unsigned char)word;
+			p += 4;
+		}
+	}
+	for(;bits>0;bits-=8)
+		*p++ = (unsigned char)(accumulator >> (bits - 8));
+	return true;
+}
+
+
+template<class Model>
+inline bool TStaticCodebook<Model>::Decode(const unsigned char *data, size_t len, std::string & out)
+{
+	// the padding is 0s then a 1, all in the first byte
+	if(len == 0 || data[0] == 0) return false;
+	unsigned int bits = 7;
+	while((data[0] >> bits) == 0) bits--;
+	uint64_t accumulator = data[0] & ((1u << bits) - 1);
+	uint64_t left = (uint64_t)(len - 1) * 8 + bits;
+
+	// every letter takes at least the shortest code
+	size_t start = out.size();
+	out.resize(start + left / tables.shortest);
+	unsigned char *p = (unsigned char *)&out[start];
+	size_t pos = 1;
+	while(left > 0) {
+		// past the end the stream reads as 0s, 'left' keeps them out
+		for(;bits<=56;bits+=8)
+			accumulator = (accumulator << 8) | (pos < len ? data[pos++] : 0);
+		const entry_t & entry = tables.decode[(accumulator >> (bits - MAX_LENGTH)) & ((1u << MAX_LENGTH) - 1)];
+		if(entry.len == 0 || entry.len > left) {
+			out.resize(start);
+			return false;
+		}
+		*p++ = entry.letter;
+		bits -= entry.len;
+		left -= entry.len;
+	}
+	out.resize(p - (unsigned char *)out.data());
+	return true;
+}
+
+
+// -- models:
+
+// english prose, mostly lower case. any other byte still gets a code
+struct TEnglishModel {
+	enum { MAX_LENGTH = 12 };
+	static constexpr uint32_t Frequency(unsigned int letter)
+	{
+		// per 10000 letters, a to z
+		const uint32_t lower[26] = {
+			650, 120, 220, 340, 1000, 180, 160, 490, 560, 10, 60, 320, 200,
+			560, 600, 150, 8, 480, 510, 720, 220, 80, 190, 10, 160, 6
+		};
+		if(letter >= 'a' && letter <= 'z') return lower[letter - 'a'];
+		if(letter >= 'A' && letter <= 'Z') return lower[letter - 'A'] / 16 + 2;
+		if(letter >= '0' && letter <= '9') return 10;
+		switch(letter) {
+			case ' ':	return 1800;
+			case ',':	return 100;
+			case '.':	return 90;
+			case '\n':	return 40;
+			case '\'':	return 25;
+			case '"':	return 20;
+			case '-':	return 15;
+			case '?':	return 5;
+			case '!':	return 4;
+			case ';':
+			case ':':	return 3;
+			case '(':
+			case ')':	return 2;
+		}
+		return 1;
+	}
+};
+
+// compact or indented JSON with english keys. any other byte still gets
+// a code
+struct TJsonModel {
+	enum { MAX_LENGTH = 12 };
+	static constexpr uint32_t Frequency(unsigned int letter)
+	{
+		if(letter >= 'a' && letter <= 'z') return TEnglishModel::Frequency(letter) / 3 + 4;
+		if(letter >= 'A' && letter <= 'Z') return TEnglishModel::Frequency(letter) / 2 + 2;
+		if(letter >= '0' && letter <= '9') return 120;
+		switch(letter) {
+			case '"':	return 800;
+			case ' ':	return 400;
+			case ':':
+			case ',':	return 200;
+			case '{':
+			case '}':	return 50;
+			case '\n':	return 60;
+			case '_':	return 30;
+			case '[':
+			case ']':	return 20;
+			case '.':
+			case '-':	return 20;
+			case '\\':
+			case '/':	return 5;
+		}
+		return 1;
+	}
+};
+
+// hex digits in lines, mostly lower case. nothing else can be encoded
+struct THexModel {
+	enum { MAX_LENGTH = 8 };
+	static constexpr uint32_t Frequency(unsigned int letter)
+	{
+		if(letter >= '0' && letter <= '9') return 64;
+		if(letter >= 'a' && letter <= 'f') return 64;
+		if(letter >= 'A' && letter <= 'F') return 4;
+		if(letter == '\n') return 2;
+		return 0;
+	}
+};
+
+typedef TStaticCodebook<TEnglishModel>	TStaticEnglish;
+typedef TStaticCodebook<TJsonModel>		TStaticJson;
+typedef TStaticCodebook<THexModel>		TStaticHex;
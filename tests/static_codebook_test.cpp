@@ -0,0 +1,62 @@
+// static_codebook_test.cpp
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - static codebook test
+	Every model in static_codebook.h has to give back what it was given,
+	both through its own Encode()/Decode() and through a THuffman preset
+	made from its lengths. Building this also makes the compiler work out
+	each codebook. Run by ctest, returns non-zero on a mismatch.
+
+	Usage Example:
+
+	ctest --test-dir build
+*/
+#include <stdio.h>
+#include <string>
+#include "huffman.h"
+#include "static_codebook.h"
+
+
+template<class Codebook>
+static bool CheckCodebook(const char *name, const std::string & text)
+{
+	std::string packed, plain;
+	bool ok = Codebook::Encode((const unsigned char *)text.data(), text.size(), packed) &&
+		Codebook::Decode((const unsigned char *)packed.data(), packed.size(), plain) && plain == text;
+
+	THuffman huff;
+	THuffmanPreset preset;
+	ok = ok && preset.Assign(1, Codebook::Lengths());
+	if(ok) {
+		huff.AddPreset(preset);
+		ok = huff.Decode(packed, 1) == text;
+	}
+	printf("%-8s %s\n", name, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+// a model can't take a letter it has no code for
+template<class Codebook>
+static bool CheckRejects(const char *name, const std::string & text)
+{
+	std::string packed;
+	bool ok = !Codebook::Encode((const unsigned char *)text.data(), text.size(), packed);
+	printf("%-8s %s\n", name, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+
+int main()
+{
+	std::string english;
+	for(int i=0;i<200;i++)
+		english += "Peter Piper picked a peck of pickled peppers; where's the peck (of 2) he picked?\n";
+
+	bool ok = CheckCodebook<TStaticEnglish>("english", english);
+	ok = CheckCodebook<TStaticJson>("json", "{\"id\": 42, \"name\": \"peter piper\", \"tags\": [\"a\", \"b\"]}\n") && ok;
+	ok = CheckCodebook<TStaticHex>("hex", "00ff1a2b\nDEADbeef\n") && ok;
+	ok = CheckRejects<TStaticHex>("hex-bad", "00ff 1a2b\n") && ok;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+// work_queue.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - TWorkQueue
+	A fixed size queue for handing items from one thread to another without
+	locks, any number of threads at either end (Dmitry Vyukov's bounded
+	queue). Push() waits while the queue is full and Pop() while it is
+	empty, so a slow stage holds back the stages feeding it. A thread that
+	has to wait more than a moment sleeps until it is woken, rather than
+	taking cpu time from the threads it is waiting for.
+
+	Usage Example:
+
+	TWorkQueue<unsigned int> queue(64);
+	// one thread
+	queue.Push(7);
+	// another thread
+	unsigned int item;
+	queue.Pop(item);
+*/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+
+template<class T>
+class TWorkQueue {
+
+	private:
+
+		/*
+		-- implimentation note --
+		every cell has a sequence number saying whose turn it is. a cell
+		is free for the push numbered 'pos' when its sequence is pos, and
+		holds the item for the pop numbered 'pos' when it is pos+1. a
+		thread claims its turn by moving 'tail' or 'head' on by one, then
+		owns that cell until it moves the sequence on
+		*/
+		struct cell_t {
+			std::atomic<size_t> sequence;
+			T data;
+		};
+
+		std::unique_ptr<cell_t[]>	cells;
+		size_t						mask;
+		// apart, so pushing and popping threads don't fight over a cache line
+		alignas(64) std::atomic<size_t> tail;		// next push
+		alignas(64) std::atomic<size_t> head;		// next pop
+
+		// only for threads that have to wait, the queue itself takes no lock
+		enum { SPINS = 16 };
+		std::mutex					sleepLock;
+		std::condition_variable		wakeUp;
+		std::atomic<unsigned int>	sleepers;
+
+		// spins a few times, then sleeps until woken. returns true if
+		// 'attempt' worked just before going to sleep
+		template<class F>
+		bool						__Wait(unsigned int, F);
+		void						__Wake();
+
+	public:
+
+		// holds at least 'size' items
+		TWorkQueue(size_t);
+
+		// return false instead of waiting
+		bool						TryPush(const T &);
+		bool						TryPop(T &);
+		void						Push(const T &);
+		void						Pop(T &);
+
+};
+
+
+template<class T>
+inline TWorkQueue<T>::TWorkQueue(size_t size)
+{
+	size_t n = 2;
+	while(n < size) n <<= 1;
+	cells.reset(new cell_t[n]);
+	for(size_t i=0;i<n;i++)
+		cells[i].sequence.store(i, std::memory_order_relaxed);
+	mask = n - 1;
+	tail.store(0, std::memory_order_relaxed);
+	head.store(0, std::memory_order_relaxed);
+	sleepers.store(0, std::memory_order_relaxed);
+}
+
+
+template<class T>
+inline bool TWorkQueue<T>::TryPush(const T & a)
+{
+	size_t pos = tail.load(std::memory_order_relaxed);
+	for(;;) {
+		cell_t & cell = cells[pos & mask];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if(diff == 0) {
+			if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				cell.data = a;
+				cell.sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		} else if(diff < 0) {
+			return false;		// full
+		} else {
+			pos = tail.load(std::memory_order_relaxed);
+		}
+	}
+}
+template<class T>
+inline bool TWorkQueue<T>::TryPop(T & a)
+{
+	size_t pos = head.load(std::memory_order_relaxed);
+	for(;;) {
+		cell_t & cell = cells[pos & mask];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+		if(diff == 0) {
+			if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				a = cell.data;
+				cell.sequence.store(pos + mask + 1, std::memory_order_release);
+				return true;
+			}
+		} else if(diff < 0) {
+			return false;		// empty
+		} else {
+			pos = head.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+
+template<class T>
+inline void TWorkQueue<T>::Push(const T & a)
+{
+	for(unsigned int tries=0;!TryPush(a);tries++)
+		if(__Wait(tries, [&] { return TryPush(a); })) break;
+	__Wake();
+}
+template<class T>
+inline void TWorkQueue<T>::Pop(T & a)
+{
+	for(unsigned int tries=0;!TryPop(a);tries++)
+		if(__Wait(tries, [&] { return TryPop(a); })) break;
+	__Wake();
+}
+
+
+/*
+	-- implimentation note --
+	a sleeper counts itself and tries once more while holding the lock.
+	whoever pushes or pops next either sees the count and wakes it, or
+	changed the queue early enough for that last try to see it. the
+	timeout is only there in case of a mistake
+*/
+template<class T>
+template<class F>
+inline bool TWorkQueue<T>::__Wait(unsigned int tries, F attempt)
+{
+	if(tries < SPINS) {
+		std::this_thread::yield();
+		return false;
+	}
+	std::unique_lock<std::mutex> guard(sleepLock);
+	sleepers++;
+	bool r = attempt();
+	if(!r) wakeUp.wait_for(guard, std::chrono::milliseconds(10));
+	sleepers--;
+	return r;
+}
+template<class T>
+inline void TWorkQueue<T>::__Wake()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(sleepers.load(std::memory_order_relaxed) == 0) return;
+	std::lock_guard<std::mutex> guard(sleepLock);
+	wakeUp.notify_all();
+}
@@ -0,0 +1,152 @@
+// worker_pool.h
+/*
+	Copyright (c) 2006, Toby Oxborrow <www.oxborrow.net>
+	All rights reserved. See LICENCE for details.
+	--
+	Toby's Huffman Compression - TWorkerPool
+	A fixed set of threads for running the same job over many items, like
+	a parallel for loop. The calling thread joins in as worker 0, so a pool
+	of one thread simply runs everything in place.
+
+	Usage Example:
+
+	TWorkerPool pool;		// one worker per hardware thread
+	std::vector<THuffman> coders(pool.Size());
+	pool.Run(blocks.size(), [&](size_t i, unsigned int worker) {
+		results[i] = coders[worker].Encode(blocks[i]);
+	});
+*/
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class TWorkerPool {
+
+	public:
+
+		// called with the item index and which worker is running it
+		typedef std::function<void(size_t, unsigned int)> job_t;
+
+	private:
+
+		std::vector<std::thread>	threads;
+		std::mutex					lock;
+		std::condition_variable		wake;		// a new job was posted, or we are stopping
+		std::condition_variable		done;		// a worker finished its share of the job
+
+		const job_t					*job;
+		size_t						jobItems;
+		std::atomic<size_t>			nextItem;
+		unsigned long				generation;	// bumped for every job
+		unsigned int				busy;		// background workers still on the current job
+		bool						stopping;
+
+		void						_Worker(unsigned int);
+		void						_Work(unsigned int);
+
+	public:
+
+		// 0 threads means one per hardware thread
+		TWorkerPool(unsigned int = 0);
+		~TWorkerPool();
+
+		// runs 'job' once for every index below 'items', returns when all are done
+		void						Run(size_t, const job_t &);
+
+		unsigned int				Size() const { return threads.size() + 1; }
+
+		static unsigned int			HardwareThreads();
+
+};
+
+
+inline unsigned int TWorkerPool::HardwareThreads()
+{
+	unsigned int n = std::thread::hardware_concurrency();
+	return (n > 0) ? n : 1;
+}
+
+
+inline TWorkerPool::TWorkerPool(unsigned int size)
+{
+	job = NULL;
+	jobItems = 0;
+	nextItem = 0;
+	generation = 0;
+	busy = 0;
+	stopping = false;
+
+	if(size == 0) size = HardwareThreads();
+	for(unsigned int i=1;i<size;i++)
+		threads.push_back(std::thread(&TWorkerPool::_Worker, this, i));
+}
+inline TWorkerPool::~TWorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(size_t i=0;i<threads.size();i++)
+		threads[i].join();
+}
+
+
+inline void TWorkerPool::Run(size_t items, const job_t & newJob)
+{
+	if(threads.empty()) {
+		for(size_t i=0;i<items;i++)
+			newJob(i, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		job = &newJob;
+		jobItems = items;
+		nextItem = 0;
+		busy = threads.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	_Work(0);
+
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [this] { return busy == 0; });
+	job = NULL;
+}
+
+
+// take items until there are none left
+inline void TWorkerPool::_Work(unsigned int worker)
+{
+	for(;;) {
+		size_t i = nextItem++;
+		if(i >= jobItems) break;
+		(*job)(i, worker);
+	}
+}
+inline void TWorkerPool::_Worker(unsigned int worker)
+{
+	unsigned long seen = 0;
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [&] { return stopping || generation != seen; });
+			if(stopping) return;
+			seen = generation;
+		}
+		_Work(worker);
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			busy--;
+		}
+		done.notify_one();
+	}
+}